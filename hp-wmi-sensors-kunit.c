@@ -0,0 +1,928 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests for the HP WMI Sensors driver.
+ *
+ * This file is included by hp-wmi-sensors.c when built with
+ * -DHP_WMI_SENSORS_KUNIT (see "make kunit"), so that the tests can reach
+ * the driver's static functions. The suite runs when the module is loaded.
+ *
+ * WMI object instances are synthesized as ACPICA would return them, for
+ * both known variants of HPBIOS_BIOSNumericSensor. Besides checking
+ * correctness, the suite logs per-call timings of the decode and scaling
+ * paths, so that optimizations can be shown not to regress them.
+ */
+
+#include <kunit/test.h>
+
+#if !IS_ENABLED(CONFIG_KUNIT)
+#error "HP_WMI_SENSORS_KUNIT needs a kernel with CONFIG_KUNIT enabled"
+#endif
+
+#define HP_WMI_TEST_RAW_SIZE	(sizeof(u16) * (HP_WMI_MAX_STR_SIZE * 2 + 1))
+#define HP_WMI_TEST_MAX_ELEMS	(HP_WMI_MAX_PROPERTIES + 1)
+#define HP_WMI_TEST_ITERATIONS	10000
+
+/*
+ * struct hp_wmi_test_pkg - a synthetic WMI object instance
+ * @wobj: the package itself
+ * @elems: storage for package elements
+ * @raw: storage for raw WMI strings, one per element
+ * @raw_strings: whether strings are added as raw WMI strings
+ *
+ * One more element than HP_WMI_MAX_PROPERTIES fits, to test rejection of
+ * oversized packages.
+ */
+struct hp_wmi_test_pkg {
+	union acpi_object wobj;
+	union acpi_object elems[HP_WMI_TEST_MAX_ELEMS];
+	u8 raw[HP_WMI_TEST_MAX_ELEMS][HP_WMI_TEST_RAW_SIZE];
+	bool raw_strings;
+};
+
+/*
+ * struct hp_wmi_test_sensor - properties of a synthetic numeric sensor
+ *
+ * Description and OtherSensorType are derived from Name; RateUnits is 0.
+ */
+struct hp_wmi_test_sensor {
+	const char *name;
+	u32 sensor_type;
+	u32 operational_status;
+	const char * const *possible_states;
+	u8 size;
+	const char *current_state;
+	u32 base_units;
+	s32 unit_modifier;
+	u32 current_reading;
+};
+
+static const char * const hp_wmi_test_states[] = {
+	"Normal", "Caution", "Critical", "Not Present",
+};
+
+static const struct hp_wmi_test_sensor hp_wmi_test_cpu_temp = {
+	.name = "CPU0 Temperature",
+	.sensor_type = HP_WMI_TYPE_TEMPERATURE,
+	.operational_status = HP_WMI_STATUS_OK,
+	.possible_states = hp_wmi_test_states,
+	.size = 3,
+	.current_state = "Caution",
+	.base_units = HP_WMI_UNITS_DEGREES_C,
+	.unit_modifier = 0,
+	.current_reading = 45,
+};
+
+static struct hp_wmi_test_pkg *hp_wmi_test_pkg_new(struct kunit *test,
+						   bool raw_strings)
+{
+	struct hp_wmi_test_pkg *pkg;
+
+	pkg = kunit_kzalloc(test, sizeof(*pkg), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, pkg);
+
+	pkg->wobj.package.type = ACPI_TYPE_PACKAGE;
+	pkg->wobj.package.elements = pkg->elems;
+	pkg->raw_strings = raw_strings;
+
+	return pkg;
+}
+
+static union acpi_object *hp_wmi_test_pkg_next(struct hp_wmi_test_pkg *pkg)
+{
+	u32 i = pkg->wobj.package.count++;
+
+	if (WARN_ON(i >= HP_WMI_TEST_MAX_ELEMS))
+		i = HP_WMI_TEST_MAX_ELEMS - 1;
+
+	return &pkg->elems[i];
+}
+
+static void hp_wmi_test_pkg_int(struct hp_wmi_test_pkg *pkg, u64 value)
+{
+	union acpi_object *element = hp_wmi_test_pkg_next(pkg);
+
+	element->integer.type = ACPI_TYPE_INTEGER;
+	element->integer.value = value;
+}
+
+/*
+ * hp_wmi_test_make_raw - encode an ASCII string as a raw WMI string
+ * @buf: buffer of HP_WMI_TEST_RAW_SIZE bytes to receive the string
+ * @str: string to encode, of at most HP_WMI_MAX_STR_SIZE * 2 characters
+ * @padding: count of null UTF-16 code units to append
+ *
+ * Returns the length of the raw WMI string in bytes.
+ */
+static u32 hp_wmi_test_make_raw(u8 *buf, const char *str, size_t padding)
+{
+	size_t count = strlen(str);
+	size_t len = count + padding;
+	__le16 *ptr = (__le16 *)buf;
+	size_t i;
+
+	/* Length prefix, in bytes. */
+	*ptr++ = cpu_to_le16(len * sizeof(*ptr));
+
+	for (i = 0; i < len; i++)
+		*ptr++ = cpu_to_le16(i < count ? str[i] : 0);
+
+	return (len + 1) * sizeof(*ptr);
+}
+
+static void hp_wmi_test_pkg_str(struct hp_wmi_test_pkg *pkg, const char *str)
+{
+	union acpi_object *element = hp_wmi_test_pkg_next(pkg);
+	u8 *raw = pkg->raw[element - pkg->elems];
+
+	if (pkg->raw_strings) {
+		element->buffer.type = ACPI_TYPE_BUFFER;
+		element->buffer.length = hp_wmi_test_make_raw(raw, str, 0);
+		element->buffer.pointer = raw;
+	} else {
+		element->string.type = ACPI_TYPE_STRING;
+		element->string.length = strlen(str);
+		element->string.pointer = (char *)str;
+	}
+}
+
+/*
+ * hp_wmi_test_pkg_sensor - synthesize a HPBIOS_BIOSNumericSensor instance
+ * @test: test context
+ * @sensor: sensor properties
+ * @is_new: whether to make a "new" variant object
+ *
+ * See struct hp_wmi_numeric_sensor for the property order of each variant.
+ */
+static struct hp_wmi_test_pkg *
+hp_wmi_test_pkg_sensor(struct kunit *test,
+		       const struct hp_wmi_test_sensor *sensor, bool is_new)
+{
+	struct hp_wmi_test_pkg *pkg = hp_wmi_test_pkg_new(test, false);
+	u8 i;
+
+	hp_wmi_test_pkg_str(pkg, sensor->name);
+	hp_wmi_test_pkg_str(pkg, "Test sensor");
+	hp_wmi_test_pkg_int(pkg, sensor->sensor_type);
+	hp_wmi_test_pkg_str(pkg, "");
+	hp_wmi_test_pkg_int(pkg, sensor->operational_status);
+
+	if (is_new) {
+		hp_wmi_test_pkg_int(pkg, sensor->size);
+		for (i = 0; i < sensor->size; i++)
+			hp_wmi_test_pkg_str(pkg, sensor->possible_states[i]);
+		hp_wmi_test_pkg_str(pkg, sensor->current_state);
+	} else {
+		hp_wmi_test_pkg_str(pkg, sensor->current_state);
+		for (i = 0; i < sensor->size; i++)
+			hp_wmi_test_pkg_str(pkg, sensor->possible_states[i]);
+	}
+
+	hp_wmi_test_pkg_int(pkg, sensor->base_units);
+	hp_wmi_test_pkg_int(pkg, (u32)sensor->unit_modifier);
+	hp_wmi_test_pkg_int(pkg, sensor->current_reading);
+
+	if (is_new)
+		hp_wmi_test_pkg_int(pkg, 0);	/* RateUnits */
+
+	return pkg;
+}
+
+static void hp_wmi_test_check_variants(struct kunit *test)
+{
+	struct hp_wmi_test_sensor sensor = hp_wmi_test_cpu_temp;
+	struct hp_wmi_test_pkg *pkg;
+	bool is_new;
+	bool out_is_new;
+	u8 out_size;
+	int variant;
+	u8 size;
+
+	for (variant = 0; variant < 2; variant++) {
+		is_new = variant;
+
+		for (size = 1; size <= ARRAY_SIZE(hp_wmi_test_states); size++) {
+			sensor.size = size;
+			pkg = hp_wmi_test_pkg_sensor(test, &sensor, is_new);
+
+			KUNIT_EXPECT_EQ(test, 0,
+					check_numeric_sensor_wobj(&pkg->wobj,
+								  &out_size,
+								  &out_is_new));
+			KUNIT_EXPECT_EQ(test, size, out_size);
+			KUNIT_EXPECT_EQ(test, is_new, out_is_new);
+		}
+	}
+}
+
+static void hp_wmi_test_check_invalid(struct kunit *test)
+{
+	const struct hp_wmi_test_sensor *sensor = &hp_wmi_test_cpu_temp;
+	union acpi_object integer = {
+		.integer = { .type = ACPI_TYPE_INTEGER, .value = 0 },
+	};
+	struct hp_wmi_test_pkg *pkg;
+	bool is_new;
+	u8 size;
+
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&integer, &size, &is_new));
+
+	/* Size disagrees with the count of PossibleStates[]. */
+	pkg = hp_wmi_test_pkg_sensor(test, sensor, true);
+	pkg->elems[HP_WMI_PROPERTY_SIZE].integer.value++;
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&pkg->wobj, &size, &is_new));
+
+	/* SensorType is not an integer. */
+	pkg = hp_wmi_test_pkg_sensor(test, sensor, true);
+	pkg->elems[HP_WMI_PROPERTY_SENSOR_TYPE].string.type =
+		ACPI_TYPE_STRING;
+	pkg->elems[HP_WMI_PROPERTY_SENSOR_TYPE].string.length = 0;
+	pkg->elems[HP_WMI_PROPERTY_SENSOR_TYPE].string.pointer = "";
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&pkg->wobj, &size, &is_new));
+
+	/* Truncated, for either variant. */
+	pkg = hp_wmi_test_pkg_sensor(test, sensor, true);
+	pkg->wobj.package.count = HP_WMI_PROPERTY_SIZE;
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&pkg->wobj, &size, &is_new));
+
+	pkg = hp_wmi_test_pkg_sensor(test, sensor, false);
+	pkg->wobj.package.count--;
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&pkg->wobj, &size, &is_new));
+
+	/* Too many elements. */
+	pkg = hp_wmi_test_pkg_sensor(test, sensor, true);
+	while (pkg->wobj.package.count <= HP_WMI_MAX_PROPERTIES)
+		hp_wmi_test_pkg_int(pkg, 0);
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			check_numeric_sensor_wobj(&pkg->wobj, &size, &is_new));
+}
+
+static void hp_wmi_test_populate(struct kunit *test)
+{
+	struct hp_wmi_test_sensor sensor = hp_wmi_test_cpu_temp;
+	struct hp_wmi_numeric_sensor nsensor;
+	struct hp_wmi_numeric_layout layout;
+	struct hp_wmi_test_pkg *pkg;
+	bool is_new;
+	int variant;
+	u8 i;
+
+	for (variant = 0; variant < 2; variant++) {
+		is_new = variant;
+		pkg = hp_wmi_test_pkg_sensor(test, &sensor, is_new);
+
+		memset(&nsensor, 0, sizeof(nsensor));
+		KUNIT_ASSERT_EQ(test, 0,
+				populate_numeric_sensor_from_wobj(NULL,
+								  &nsensor,
+								  &layout,
+								  &pkg->wobj));
+
+		KUNIT_EXPECT_STREQ(test, sensor.name, nsensor.name);
+		KUNIT_EXPECT_STREQ(test, "Test sensor", nsensor.description);
+		KUNIT_EXPECT_EQ(test, sensor.sensor_type, nsensor.sensor_type);
+		KUNIT_EXPECT_STREQ(test, "", nsensor.other_sensor_type);
+		KUNIT_EXPECT_EQ(test, sensor.operational_status,
+				nsensor.operational_status);
+		KUNIT_EXPECT_EQ(test, sensor.size, nsensor.size);
+		for (i = 0; i < sensor.size; i++)
+			KUNIT_EXPECT_STREQ(test, sensor.possible_states[i],
+					   nsensor.possible_states[i]);
+		KUNIT_EXPECT_EQ(test, 1, nsensor.current_state);
+		KUNIT_EXPECT_NULL(test, nsensor.possible_states[sensor.size]);
+		KUNIT_EXPECT_EQ(test, sensor.base_units, nsensor.base_units);
+		KUNIT_EXPECT_EQ(test, sensor.unit_modifier,
+				nsensor.unit_modifier);
+		KUNIT_EXPECT_EQ(test, sensor.current_reading,
+				nsensor.current_reading);
+		KUNIT_EXPECT_EQ(test, 45000, scale_numeric_sensor(&nsensor));
+
+		KUNIT_EXPECT_EQ(test, is_new, layout.is_new);
+		KUNIT_EXPECT_EQ(test, pkg->wobj.package.count,
+				layout.elem_count);
+		KUNIT_EXPECT_EQ(test, ACPI_TYPE_STRING,
+				pkg->elems[layout.current_state].type);
+		KUNIT_EXPECT_EQ(test, (u32)sensor.unit_modifier,
+				pkg->elems[layout.unit_modifier].integer.value);
+		KUNIT_EXPECT_EQ(test, sensor.current_reading,
+				pkg->elems[layout.current_reading]
+					.integer.value);
+
+		put_numeric_sensor(NULL, &nsensor);
+	}
+
+	/* A CurrentState not in PossibleStates[] goes in the spare slot. */
+	sensor.current_state = "Unlisted";
+	pkg = hp_wmi_test_pkg_sensor(test, &sensor, true);
+
+	memset(&nsensor, 0, sizeof(nsensor));
+	KUNIT_ASSERT_EQ(test, 0,
+			populate_numeric_sensor_from_wobj(NULL, &nsensor,
+							  &layout,
+							  &pkg->wobj));
+	KUNIT_EXPECT_EQ(test, sensor.size, nsensor.current_state);
+	KUNIT_EXPECT_STREQ(test, "Unlisted",
+			   nsensor.possible_states[sensor.size]);
+
+	put_numeric_sensor(NULL, &nsensor);
+}
+
+static void hp_wmi_test_update(struct kunit *test)
+{
+	struct hp_wmi_test_sensor sensor = hp_wmi_test_cpu_temp;
+	struct hp_wmi_numeric_sensor nsensor = {};
+	struct hp_wmi_numeric_layout layout;
+	union acpi_object integer = {
+		.integer = { .type = ACPI_TYPE_INTEGER, .value = 0 },
+	};
+	struct hp_wmi_test_pkg *pkg;
+	u8 size = sensor.size;
+
+	pkg = hp_wmi_test_pkg_sensor(test, &sensor, false);
+	KUNIT_ASSERT_EQ(test, 0,
+			populate_numeric_sensor_from_wobj(NULL, &nsensor,
+							  &layout,
+							  &pkg->wobj));
+
+	/* Same shape: only the fungible properties are taken. */
+	sensor.operational_status = HP_WMI_STATUS_DEGRADED;
+	sensor.current_state = "Critical";
+	sensor.unit_modifier = -1;
+	sensor.current_reading = 987;
+	pkg = hp_wmi_test_pkg_sensor(test, &sensor, false);
+
+	KUNIT_EXPECT_EQ(test, 0,
+			update_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, &pkg->wobj));
+	KUNIT_EXPECT_EQ(test, HP_WMI_STATUS_DEGRADED,
+			nsensor.operational_status);
+	KUNIT_EXPECT_EQ(test, 2, nsensor.current_state);
+	KUNIT_EXPECT_EQ(test, -1, nsensor.unit_modifier);
+	KUNIT_EXPECT_EQ(test, -1, nsensor.scale.unit_modifier);
+	KUNIT_EXPECT_EQ(test, 987, nsensor.current_reading);
+	KUNIT_EXPECT_EQ(test, 98700, scale_numeric_sensor(&nsensor));
+
+	/* An unlisted CurrentState is kept, as at probe. */
+	sensor.current_state = "Unlisted";
+	pkg = hp_wmi_test_pkg_sensor(test, &sensor, false);
+
+	KUNIT_EXPECT_EQ(test, 0,
+			update_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, &pkg->wobj));
+	KUNIT_EXPECT_EQ(test, size, nsensor.current_state);
+	KUNIT_EXPECT_STREQ(test, "Unlisted", nsensor.possible_states[size]);
+
+	/* A changed shape is revalidated and the layout remade. */
+	sensor.current_state = "Normal";
+	sensor.current_reading = 50;
+	pkg = hp_wmi_test_pkg_sensor(test, &sensor, true);
+
+	KUNIT_EXPECT_EQ(test, 0,
+			update_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, &pkg->wobj));
+	KUNIT_EXPECT_TRUE(test, layout.is_new);
+	KUNIT_EXPECT_EQ(test, 0, nsensor.current_state);
+	KUNIT_EXPECT_EQ(test, 50, nsensor.current_reading);
+
+	/* An invalid instance leaves the sensor as it was. */
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			update_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, &integer));
+	KUNIT_EXPECT_EQ(test, 50, nsensor.current_reading);
+
+	put_numeric_sensor(NULL, &nsensor);
+}
+
+static void hp_wmi_test_raw_string(struct kunit *test)
+{
+	char dst[HP_WMI_MAX_STR_SIZE];
+	char long_str[HP_WMI_MAX_STR_SIZE * 2];
+	u8 *raw;
+	char *str;
+	u32 len;
+
+	raw = kunit_kzalloc(test, HP_WMI_TEST_RAW_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, raw);
+
+	len = hp_wmi_test_make_raw(raw, "CPU Fan Speed", 0);
+	KUNIT_EXPECT_TRUE(test, is_raw_wmi_string(raw, len));
+	copy_raw_wmi_string(raw, dst);
+	KUNIT_EXPECT_STREQ(test, "CPU Fan Speed", dst);
+
+	str = convert_raw_wmi_string(raw);
+	KUNIT_ASSERT_NOT_NULL(test, str);
+	KUNIT_EXPECT_STREQ(test, "CPU Fan Speed", str);
+	kfree(str);
+
+	/* Trailing null padding is excluded. */
+	len = hp_wmi_test_make_raw(raw, "Hood", 3);
+	KUNIT_EXPECT_TRUE(test, is_raw_wmi_string(raw, len));
+	copy_raw_wmi_string(raw, dst);
+	KUNIT_EXPECT_STREQ(test, "Hood", dst);
+
+	/* Non-ASCII code points become UTF-8. */
+	len = hp_wmi_test_make_raw(raw, "xC", 0);
+	((__le16 *)raw)[1] = cpu_to_le16(0x00b0);	/* DEGREE SIGN */
+	copy_raw_wmi_string(raw, dst);
+	KUNIT_EXPECT_STREQ(test, "\xc2\xb0" "C", dst);
+
+	/* Long strings are truncated to fit. */
+	memset(long_str, 'a', sizeof(long_str) - 1);
+	long_str[sizeof(long_str) - 1] = '\0';
+	len = hp_wmi_test_make_raw(raw, long_str, 0);
+	copy_raw_wmi_string(raw, dst);
+	KUNIT_EXPECT_EQ(test, HP_WMI_MAX_STR_SIZE - 1, strlen(dst));
+
+	/* The length prefix must be even and fit in the buffer. */
+	len = hp_wmi_test_make_raw(raw, "Fan", 0);
+	KUNIT_EXPECT_FALSE(test, is_raw_wmi_string(raw, len - 1));
+	KUNIT_EXPECT_FALSE(test, is_raw_wmi_string(raw, sizeof(u16)));
+	*(__le16 *)raw = cpu_to_le16(len);
+	KUNIT_EXPECT_FALSE(test, is_raw_wmi_string(raw, len));
+}
+
+/* hp_wmi_test_pkg_event - synthesize a HPBIOS_BIOSEvent instance */
+static struct hp_wmi_test_pkg *hp_wmi_test_pkg_event(struct kunit *test,
+						     const char *name,
+						     const char *description,
+						     bool raw_strings)
+{
+	struct hp_wmi_test_pkg *pkg = hp_wmi_test_pkg_new(test, raw_strings);
+
+	hp_wmi_test_pkg_str(pkg, name);
+	hp_wmi_test_pkg_str(pkg, description);
+	hp_wmi_test_pkg_int(pkg, HP_WMI_CATEGORY_SENSOR);
+	hp_wmi_test_pkg_int(pkg, HP_WMI_SEVERITY_CRITICAL_FAILURE);
+	hp_wmi_test_pkg_int(pkg, HP_WMI_STATUS_OK);
+
+	return pkg;
+}
+
+static void hp_wmi_test_event(struct kunit *test)
+{
+	struct hp_wmi_test_pkg *pkg;
+	struct hp_wmi_event event;
+	int variant;
+
+	/* Both plain and raw WMI strings occur in events [3]. */
+	for (variant = 0; variant < 2; variant++) {
+		pkg = hp_wmi_test_pkg_event(test, " Thermal Critical ",
+					    "CPU Thermal Index", variant);
+
+		memset(&event, 0, sizeof(event));
+		KUNIT_EXPECT_EQ(test, 0,
+				populate_event_from_wobj(&event, &pkg->wobj));
+		KUNIT_EXPECT_STREQ(test, "Thermal Critical", event.name);
+		KUNIT_EXPECT_STREQ(test, "CPU Thermal Index",
+				   event.description);
+		KUNIT_EXPECT_EQ(test, HP_WMI_CATEGORY_SENSOR, event.category);
+		KUNIT_EXPECT_EQ(test, HP_WMI_TYPE_TEMPERATURE,
+				classify_event(event.name, event.category));
+	}
+
+	pkg = hp_wmi_test_pkg_event(test, "CPU Fan Stall", "CPU Fan Speed",
+				    true);
+	KUNIT_EXPECT_EQ(test, 0, populate_event_from_wobj(&event, &pkg->wobj));
+	KUNIT_EXPECT_EQ(test, HP_WMI_TYPE_AIR_FLOW,
+			classify_event(event.name, event.category));
+
+	/* Missing Status. */
+	pkg->wobj.package.count--;
+	KUNIT_EXPECT_EQ(test, -EINVAL,
+			populate_event_from_wobj(&event, &pkg->wobj));
+}
+
+static void hp_wmi_test_platform_events(struct kunit *test)
+{
+	struct hp_wmi_platform_events *pevents;
+	struct hp_wmi_test_pkg *pkg;
+	int variant;
+
+	/* put_platform_events() also frees the array itself. */
+	for (variant = 0; variant < 2; variant++) {
+		pkg = hp_wmi_test_pkg_new(test, variant);
+
+		hp_wmi_test_pkg_str(pkg, "Hood Intrusion");
+		hp_wmi_test_pkg_str(pkg, "Chassis hood intrusion");
+		hp_wmi_test_pkg_str(pkg, HP_WMI_EVENT_NAMESPACE);
+		hp_wmi_test_pkg_str(pkg, HP_WMI_EVENT_CLASS);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_CATEGORY_SENSOR);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_SEVERITY_MINOR_FAILURE);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_STATUS_OK);
+
+		pevents = hp_wmi_kcalloc(NULL, 1, sizeof(*pevents));
+		KUNIT_ASSERT_NOT_NULL(test, pevents);
+
+		KUNIT_EXPECT_EQ(test, 0,
+				populate_platform_events_from_wobj(NULL,
+								   pevents,
+								   &pkg->wobj));
+		KUNIT_EXPECT_STREQ(test, "Hood Intrusion", pevents->name);
+		KUNIT_EXPECT_STREQ(test, "Chassis hood intrusion",
+				   pevents->description);
+		KUNIT_EXPECT_EQ(test, HP_WMI_CATEGORY_SENSOR,
+				pevents->category);
+		KUNIT_EXPECT_EQ(test, HP_WMI_SEVERITY_MINOR_FAILURE,
+				pevents->possible_severity);
+		put_platform_events(NULL, pevents, 1);
+
+		/* Events from another namespace are not ours. */
+		pkg->wobj.package.count = 0;
+		hp_wmi_test_pkg_str(pkg, "Hood Intrusion");
+		hp_wmi_test_pkg_str(pkg, "Chassis hood intrusion");
+		hp_wmi_test_pkg_str(pkg, "root\\cimv2");
+		hp_wmi_test_pkg_str(pkg, HP_WMI_EVENT_CLASS);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_CATEGORY_SENSOR);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_SEVERITY_MINOR_FAILURE);
+		hp_wmi_test_pkg_int(pkg, HP_WMI_STATUS_OK);
+
+		pevents = hp_wmi_kcalloc(NULL, 1, sizeof(*pevents));
+		KUNIT_ASSERT_NOT_NULL(test, pevents);
+
+		KUNIT_EXPECT_EQ(test, -EINVAL,
+				populate_platform_events_from_wobj(NULL,
+								   pevents,
+								   &pkg->wobj));
+		put_platform_events(NULL, pevents, 1);
+	}
+}
+
+/*
+ * hp_wmi_test_scale_stepwise - scale a reading as the driver used to
+ * @nsensor: pointer to numeric sensor struct
+ *
+ * The reference for scaling plans: one DIV_ROUND_CLOSEST(val, 10) or
+ * saturating multiplication by 10 per step of UnitModifier.
+ */
+static long
+hp_wmi_test_scale_stepwise(const struct hp_wmi_numeric_sensor *nsensor)
+{
+	u32 current_reading = nsensor->current_reading;
+	s32 unit_modifier = nsensor->unit_modifier;
+	u32 sensor_type = nsensor->sensor_type;
+	u32 base_units = nsensor->base_units;
+	s32 target_modifier;
+	long val;
+
+	/* Fan readings are in RPM units; others are in milliunits. */
+	target_modifier = sensor_type == HP_WMI_TYPE_AIR_FLOW ? 0 : -3;
+
+	val = current_reading;
+
+	for (; unit_modifier < target_modifier; unit_modifier++)
+		val = DIV_ROUND_CLOSEST(val, 10);
+
+	for (; unit_modifier > target_modifier; unit_modifier--) {
+		if (val > LONG_MAX / 10) {
+			val = LONG_MAX;
+			break;
+		}
+		val *= 10;
+	}
+
+	if (sensor_type == HP_WMI_TYPE_TEMPERATURE) {
+		switch (base_units) {
+		case HP_WMI_UNITS_DEGREES_F:
+			val -= MILLI * 32;
+			val = val <= LONG_MAX / 5 ?
+				      DIV_ROUND_CLOSEST(val * 5, 9) :
+				      DIV_ROUND_CLOSEST(val, 9) * 5;
+			break;
+
+		case HP_WMI_UNITS_DEGREES_K:
+			val = milli_kelvin_to_millicelsius(val);
+			break;
+		}
+	}
+
+	return val;
+}
+
+static const struct {
+	u32 sensor_type;
+	u32 base_units;
+} hp_wmi_test_units[] = {
+	{ HP_WMI_TYPE_TEMPERATURE,	HP_WMI_UNITS_DEGREES_C },
+	{ HP_WMI_TYPE_TEMPERATURE,	HP_WMI_UNITS_DEGREES_F },
+	{ HP_WMI_TYPE_TEMPERATURE,	HP_WMI_UNITS_DEGREES_K },
+	{ HP_WMI_TYPE_VOLTAGE,		HP_WMI_UNITS_VOLTS },
+	{ HP_WMI_TYPE_CURRENT,		HP_WMI_UNITS_AMPS },
+	{ HP_WMI_TYPE_AIR_FLOW,		HP_WMI_UNITS_RPM },
+};
+
+/* Rounding boundaries at several magnitudes, and the extremes. */
+static const u32 hp_wmi_test_readings[] = {
+	0, 1, 4, 5, 6, 9, 10, 14, 15, 44, 45, 49, 50, 54, 55, 94, 95, 99,
+	100, 444, 445, 449, 450, 499, 500, 554, 555, 4444, 4445, 5554, 5555,
+	273150, 999999, 1000000, 54999999, 55555555, 2147483647, 2147483648,
+	4294967294, 4294967295,
+};
+
+static bool hp_wmi_test_scale_one(struct kunit *test,
+				  struct hp_wmi_numeric_sensor *nsensor)
+{
+	long expected = hp_wmi_test_scale_stepwise(nsensor);
+	long actual = scale_numeric_sensor(nsensor);
+
+	KUNIT_EXPECT_EQ_MSG(test, expected, actual,
+			    "type %u units %u modifier %d reading %u",
+			    nsensor->sensor_type, nsensor->base_units,
+			    nsensor->unit_modifier, nsensor->current_reading);
+
+	return expected == actual;
+}
+
+static void hp_wmi_test_scale(struct kunit *test)
+{
+	struct hp_wmi_numeric_sensor nsensor = {};
+	unsigned int checked = 0;
+	unsigned int failed = 0;
+	s32 target_modifier;
+	s32 unit_modifier;
+	u64 limit;
+	u32 exponent;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < ARRAY_SIZE(hp_wmi_test_units); i++) {
+		nsensor.sensor_type = hp_wmi_test_units[i].sensor_type;
+		nsensor.base_units = hp_wmi_test_units[i].base_units;
+
+		target_modifier =
+			nsensor.sensor_type == HP_WMI_TYPE_AIR_FLOW ? 0 : -3;
+
+		for (unit_modifier = -40; unit_modifier <= 40;
+		     unit_modifier++) {
+			nsensor.unit_modifier = unit_modifier;
+			make_numeric_scale(&nsensor);
+
+			for (j = 0; j < ARRAY_SIZE(hp_wmi_test_readings); j++) {
+				nsensor.current_reading =
+					hp_wmi_test_readings[j];
+				failed += !hp_wmi_test_scale_one(test,
+								 &nsensor);
+				checked++;
+			}
+
+			/* Saturation starts right above LONG_MAX / 10^n. */
+			if (unit_modifier <= target_modifier)
+				continue;
+
+			exponent = unit_modifier - target_modifier;
+			if (exponent >= ARRAY_SIZE(hp_wmi_pow10) ||
+			    hp_wmi_pow10[exponent] > LONG_MAX)
+				continue;
+
+			limit = LONG_MAX / hp_wmi_pow10[exponent];
+
+			for (j = 0; j < 2 && limit + j <= U32_MAX; j++) {
+				nsensor.current_reading = limit + j;
+				failed += !hp_wmi_test_scale_one(test,
+								 &nsensor);
+				checked++;
+			}
+		}
+	}
+
+	kunit_info(test, "%u of %u scaling cases match the stepwise loop\n",
+		   checked - failed, checked);
+}
+
+static long hp_wmi_test_average(const struct hp_wmi_reading *reading)
+{
+	return hp_wmi_reading_attr(reading, hwmon_in, hwmon_in_average);
+}
+
+/*
+ * hp_wmi_test_history - check lowest, highest and average bookkeeping
+ *
+ * A steady reading must pull the average all the way to it, which a
+ * truncating update stops short of by up to HP_WMI_EWMA_WEIGHT - 1.
+ */
+static void hp_wmi_test_history(struct kunit *test)
+{
+	struct hp_wmi_reading reading = { .type = hwmon_in };
+	int i;
+
+	/* A reset while faulty starts nothing... */
+	reading.cached_val = -1;
+	reading.fault = true;
+	reset_reading_history(&reading);
+	KUNIT_EXPECT_FALSE(test, reading.has_history);
+
+	/* ...so the first good reading does. */
+	reading.cached_val = 12000;
+	reading.fault = false;
+	update_reading_history(&reading);
+	KUNIT_EXPECT_TRUE(test, reading.has_history);
+	KUNIT_EXPECT_EQ(test, reading.lowest, 12000L);
+	KUNIT_EXPECT_EQ(test, reading.highest, 12000L);
+	KUNIT_EXPECT_EQ(test, hp_wmi_test_average(&reading), 12000L);
+
+	reading.cached_val = 12007;
+	for (i = 0; i < 200; i++)
+		update_reading_history(&reading);
+	KUNIT_EXPECT_EQ(test, hp_wmi_test_average(&reading), 12007L);
+
+	reading.cached_val = -3;
+	for (i = 0; i < 200; i++)
+		update_reading_history(&reading);
+	KUNIT_EXPECT_EQ(test, hp_wmi_test_average(&reading), -3L);
+	KUNIT_EXPECT_EQ(test, reading.lowest, -3L);
+	KUNIT_EXPECT_EQ(test, reading.highest, 12007L);
+
+	/* Saturated readings must not overflow the average. */
+	reading.cached_val = LONG_MAX;
+	update_reading_history(&reading);
+	reading.cached_val = LONG_MIN;
+	for (i = 0; i < 200; i++)
+		update_reading_history(&reading);
+	KUNIT_EXPECT_LT(test, hp_wmi_test_average(&reading), 0L);
+	KUNIT_EXPECT_EQ(test, reading.lowest, LONG_MIN);
+	KUNIT_EXPECT_EQ(test, reading.highest, LONG_MAX);
+
+	reading.cached_val = 500;
+	reset_reading_history(&reading);
+	KUNIT_EXPECT_EQ(test, reading.lowest, 500L);
+	KUNIT_EXPECT_EQ(test, reading.highest, 500L);
+	KUNIT_EXPECT_EQ(test, hp_wmi_test_average(&reading), 500L);
+}
+
+/*
+ * hp_wmi_test_expires - check staleness with and without a polling margin
+ *
+ * The reading is backdated by a jiffy so that it is stale at the end of
+ * its lifetime even if jiffies does not advance meanwhile.
+ */
+static void hp_wmi_test_expires(struct kunit *test)
+{
+	struct hp_wmi_reading reading = { .type = hwmon_temp };
+	struct hp_wmi_sensors *state;
+	unsigned long lifetime;
+
+	state = kunit_kzalloc(test, sizeof(*state), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, state);
+
+	state->update_interval = 1000;
+
+	lifetime = hp_wmi_reading_lifetime(state, &reading);
+	KUNIT_ASSERT_GE(test, lifetime, 4UL);
+
+	reading.last_updated = jiffies - 1;
+
+	KUNIT_EXPECT_FALSE(test, hp_wmi_reading_is_stale(state, &reading));
+	KUNIT_EXPECT_FALSE(test, hp_wmi_reading_expires(state, &reading,
+							lifetime / 2));
+
+	/* A poll as long as the lifetime must not leave it to the next. */
+	KUNIT_EXPECT_TRUE(test, hp_wmi_reading_expires(state, &reading,
+						       lifetime));
+
+	/* As invalidated on resume; a margin must not wrap around. */
+	reading.last_updated = jiffies - LONG_MAX;
+
+	KUNIT_EXPECT_TRUE(test, hp_wmi_reading_is_stale(state, &reading));
+	KUNIT_EXPECT_TRUE(test, hp_wmi_reading_expires(state, &reading,
+						       lifetime * 2));
+	KUNIT_EXPECT_TRUE(test, hp_wmi_reading_expires(state, &reading,
+						       ULONG_MAX));
+}
+
+static void hp_wmi_test_report(struct kunit *test, const char *what,
+			       u64 ns, u32 count)
+{
+	kunit_info(test, "%-36s %8llu ns/call\n", what, div_u64(ns, count));
+}
+
+/*
+ * hp_wmi_test_timing - log per-call timings of the decode and scaling paths
+ *
+ * Timings depend on the machine and are only logged, never checked.
+ */
+static void hp_wmi_test_timing(struct kunit *test)
+{
+	struct hp_wmi_test_sensor sensor = hp_wmi_test_cpu_temp;
+	struct hp_wmi_numeric_sensor nsensor;
+	struct hp_wmi_numeric_layout layout;
+	struct hp_wmi_test_pkg *pkg;
+	char dst[HP_WMI_MAX_STR_SIZE];
+	struct hp_wmi_event event;
+	volatile long sink;
+	bool out_is_new;
+	bool is_new;
+	u64 start;
+	int variant;
+	u8 size;
+	u8 *raw;
+	u32 i;
+
+	for (variant = 0; variant < 2; variant++) {
+		is_new = variant;
+		pkg = hp_wmi_test_pkg_sensor(test, &sensor, is_new);
+
+		start = ktime_get_ns();
+		for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+			check_numeric_sensor_wobj(&pkg->wobj, &size,
+						  &out_is_new);
+		hp_wmi_test_report(test, variant ?
+				   "check_numeric_sensor_wobj (new)" :
+				   "check_numeric_sensor_wobj (old)",
+				   ktime_get_ns() - start,
+				   HP_WMI_TEST_ITERATIONS);
+
+		start = ktime_get_ns();
+		for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++) {
+			memset(&nsensor, 0, sizeof(nsensor));
+			populate_numeric_sensor_from_wobj(NULL, &nsensor,
+							  &layout, &pkg->wobj);
+			put_numeric_sensor(NULL, &nsensor);
+		}
+		hp_wmi_test_report(test, variant ?
+				   "populate + put (new)" :
+				   "populate + put (old)",
+				   ktime_get_ns() - start,
+				   HP_WMI_TEST_ITERATIONS);
+
+		memset(&nsensor, 0, sizeof(nsensor));
+		KUNIT_ASSERT_EQ(test, 0,
+				populate_numeric_sensor_from_wobj(NULL,
+								  &nsensor,
+								  &layout,
+								  &pkg->wobj));
+
+		start = ktime_get_ns();
+		for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+			update_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, &pkg->wobj);
+		hp_wmi_test_report(test, variant ?
+				   "update_numeric_sensor_from_wobj (new)" :
+				   "update_numeric_sensor_from_wobj (old)",
+				   ktime_get_ns() - start,
+				   HP_WMI_TEST_ITERATIONS);
+
+		put_numeric_sensor(NULL, &nsensor);
+	}
+
+	nsensor.sensor_type = HP_WMI_TYPE_TEMPERATURE;
+	nsensor.base_units = HP_WMI_UNITS_DEGREES_F;
+	nsensor.unit_modifier = -2;
+	nsensor.current_reading = 12345;
+	make_numeric_scale(&nsensor);
+
+	start = ktime_get_ns();
+	for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+		sink = scale_numeric_sensor(&nsensor);
+	hp_wmi_test_report(test, "scale_numeric_sensor",
+			   ktime_get_ns() - start, HP_WMI_TEST_ITERATIONS);
+
+	start = ktime_get_ns();
+	for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+		sink = hp_wmi_test_scale_stepwise(&nsensor);
+	hp_wmi_test_report(test, "stepwise scaling (reference)",
+			   ktime_get_ns() - start, HP_WMI_TEST_ITERATIONS);
+	(void)sink;
+
+	raw = kunit_kzalloc(test, HP_WMI_TEST_RAW_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, raw);
+	hp_wmi_test_make_raw(raw, "Chassis Thermal Index", 0);
+
+	start = ktime_get_ns();
+	for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+		copy_raw_wmi_string(raw, dst);
+	hp_wmi_test_report(test, "copy_raw_wmi_string",
+			   ktime_get_ns() - start, HP_WMI_TEST_ITERATIONS);
+
+	pkg = hp_wmi_test_pkg_event(test, "Thermal Critical",
+				    "CPU Thermal Index", true);
+
+	start = ktime_get_ns();
+	for (i = 0; i < HP_WMI_TEST_ITERATIONS; i++)
+		populate_event_from_wobj(&event, &pkg->wobj);
+	hp_wmi_test_report(test, "populate_event_from_wobj (raw)",
+			   ktime_get_ns() - start, HP_WMI_TEST_ITERATIONS);
+}
+
+static struct kunit_case hp_wmi_sensors_test_cases[] = {
+	KUNIT_CASE(hp_wmi_test_check_variants),
+	KUNIT_CASE(hp_wmi_test_check_invalid),
+	KUNIT_CASE(hp_wmi_test_populate),
+	KUNIT_CASE(hp_wmi_test_update),
+	KUNIT_CASE(hp_wmi_test_raw_string),
+	KUNIT_CASE(hp_wmi_test_event),
+	KUNIT_CASE(hp_wmi_test_platform_events),
+	KUNIT_CASE(hp_wmi_test_scale),
+	KUNIT_CASE(hp_wmi_test_history),
+	KUNIT_CASE(hp_wmi_test_expires),
+	KUNIT_CASE(hp_wmi_test_timing),
+	{}
+};
+
+static struct kunit_suite hp_wmi_sensors_test_suite = {
+	.name = "hp-wmi-sensors",
+	.test_cases = hp_wmi_sensors_test_cases,
+};
+kunit_test_suite(hp_wmi_sensors_test_suite);
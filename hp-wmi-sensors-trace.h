@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the HP WMI Sensors driver.
+ *
+ * Copyright (C) 2023 James Seo <james@equiv.tech>
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hp_wmi_sensors
+
+#if !defined(_HP_WMI_SENSORS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HP_WMI_SENSORS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* Event strings are truncated to this size, including the terminator. */
+#define HP_WMI_TRACE_STR_SIZE	64
+
+TRACE_EVENT(hp_wmi_sensors_query_start,
+
+	TP_PROTO(u8 instance),
+
+	TP_ARGS(instance),
+
+	TP_STRUCT__entry(
+		__field(u8, instance)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+	),
+
+	TP_printk("instance=%u", __entry->instance)
+);
+
+TRACE_EVENT(hp_wmi_sensors_query_end,
+
+	TP_PROTO(u8 instance, u64 duration_ns, int ret),
+
+	TP_ARGS(instance, duration_ns, ret),
+
+	TP_STRUCT__entry(
+		__field(u8, instance)
+		__field(u64, duration_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->duration_ns = duration_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("instance=%u duration_ns=%llu ret=%d",
+		  __entry->instance, __entry->duration_ns, __entry->ret)
+);
+
+TRACE_EVENT(hp_wmi_sensors_decode,
+
+	TP_PROTO(u8 instance, bool is_new, int ret),
+
+	TP_ARGS(instance, is_new, ret),
+
+	TP_STRUCT__entry(
+		__field(u8, instance)
+		__field(bool, is_new)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->is_new = is_new;
+		__entry->ret = ret;
+	),
+
+	TP_printk("instance=%u variant=%s ret=%d", __entry->instance,
+		  __entry->is_new ? "new" : "old", __entry->ret)
+);
+
+TRACE_EVENT(hp_wmi_sensors_cache_hit,
+
+	TP_PROTO(u8 instance, u8 type),
+
+	TP_ARGS(instance, type),
+
+	TP_STRUCT__entry(
+		__field(u8, instance)
+		__field(u8, type)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->type = type;
+	),
+
+	TP_printk("instance=%u type=%u", __entry->instance, __entry->type)
+);
+
+TRACE_EVENT(hp_wmi_sensors_event,
+
+	TP_PROTO(const char *name, const char *description, u32 category,
+		 int ret),
+
+	TP_ARGS(name, description, category, ret),
+
+	TP_STRUCT__entry(
+		__array(char, name, HP_WMI_TRACE_STR_SIZE)
+		__array(char, description, HP_WMI_TRACE_STR_SIZE)
+		__field(u32, category)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->name, name, HP_WMI_TRACE_STR_SIZE);
+		strscpy(__entry->description, description,
+			HP_WMI_TRACE_STR_SIZE);
+		__entry->category = category;
+		__entry->ret = ret;
+	),
+
+	TP_printk("name=\"%s\" description=\"%s\" category=%u ret=%d",
+		  __entry->name, __entry->description, __entry->category,
+		  __entry->ret)
+);
+
+TRACE_EVENT(hp_wmi_sensors_dispatch,
+
+	TP_PROTO(const char *name, const char *description, bool matched),
+
+	TP_ARGS(name, description, matched),
+
+	TP_STRUCT__entry(
+		__array(char, name, HP_WMI_TRACE_STR_SIZE)
+		__array(char, description, HP_WMI_TRACE_STR_SIZE)
+		__field(bool, matched)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->name, name, HP_WMI_TRACE_STR_SIZE);
+		strscpy(__entry->description, description,
+			HP_WMI_TRACE_STR_SIZE);
+		__entry->matched = matched;
+	),
+
+	TP_printk("name=\"%s\" description=\"%s\" matched=%d",
+		  __entry->name, __entry->description, __entry->matched)
+);
+
+#endif /* _HP_WMI_SENSORS_TRACE_H */
+
+/* This part must be outside protection. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hp-wmi-sensors-trace
+#include <trace/define_trace.h>
@@ -22,13 +22,29 @@
  */
 
 #include <linux/acpi.h>
+#include <linux/bitmap.h>
 #include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/hashtable.h>
 #include <linux/hwmon.h>
+#include <linux/jhash.h>
 #include <linux/jiffies.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
 #include <linux/mutex.h>
 #include <linux/nls.h>
+#include <linux/platform_device.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
 #include <linux/units.h>
 #include <linux/wmi.h>
+#include <linux/workqueue.h>
+
+#define CREATE_TRACE_POINTS
+#include "hp-wmi-sensors-trace.h"
 
 #define HP_WMI_EVENT_NAMESPACE		"root\\WMI"
 #define HP_WMI_EVENT_CLASS		"HPBIOS_BIOSEvent"
@@ -53,7 +69,76 @@
 
 #define HP_WMI_MAX_STR_SIZE		128U
 #define HP_WMI_MAX_PROPERTIES		32U
-#define HP_WMI_MAX_INSTANCES		32U
+#define HP_WMI_MAX_INSTANCES		256U	/* Instance numbers are u8. */
+#define HP_WMI_EVENT_BUF_SIZE		1024U
+#define HP_WMI_ROUTE_HASH_BITS		5U
+#define HP_WMI_EVENT_QUEUE_LEN		16U	/* Must be a power of 2. */
+#define HP_WMI_STATS_BUCKETS		16U
+#define HP_WMI_RAW_SIZE			1024U
+#define HP_WMI_MAX_HISTORY_LEN		65536U
+#define HP_WMI_EWMA_WEIGHT		8	/* Weight of the past is 7/8. */
+#define HP_WMI_EWMA_FRAC_BITS		8	/* Fixed point average. */
+#define HP_WMI_EWMA_ONE			(1L << HP_WMI_EWMA_FRAC_BITS)
+
+/* Largest magnitude averaged as is; the difference of two must not overflow. */
+#define HP_WMI_EWMA_LIMIT	(LONG_MAX >> (HP_WMI_EWMA_FRAC_BITS + 1))
+
+/* Sensor cache lifetimes, in milliseconds. */
+
+#define HP_WMI_DEFAULT_UPDATE_INTERVAL	1000U
+#define HP_WMI_MAX_UPDATE_INTERVAL	(60U * 60U * 1000U)
+
+static unsigned int poll_interval;
+module_param(poll_interval, uint, 0444);
+MODULE_PARM_DESC(poll_interval,
+		 "Background polling interval in ms (default: 0 = poll on read)");
+
+/* Per-type overrides of the per-chip update_interval. 0 means no override. */
+static unsigned int update_intervals[hwmon_max];
+module_param_named(temp_update_interval, update_intervals[hwmon_temp],
+		   uint, 0644);
+MODULE_PARM_DESC(temp_update_interval,
+		 "Temperature sensor cache lifetime in ms (default: 0 = update_interval)");
+module_param_named(in_update_interval, update_intervals[hwmon_in],
+		   uint, 0644);
+MODULE_PARM_DESC(in_update_interval,
+		 "Voltage sensor cache lifetime in ms (default: 0 = update_interval)");
+module_param_named(curr_update_interval, update_intervals[hwmon_curr],
+		   uint, 0644);
+MODULE_PARM_DESC(curr_update_interval,
+		 "Current sensor cache lifetime in ms (default: 0 = update_interval)");
+module_param_named(fan_update_interval, update_intervals[hwmon_fan],
+		   uint, 0644);
+MODULE_PARM_DESC(fan_update_interval,
+		 "Fan sensor cache lifetime in ms (default: 0 = update_interval)");
+
+static bool notify_faults;
+module_param(notify_faults, bool, 0644);
+MODULE_PARM_DESC(notify_faults,
+		 "Notify userspace when polling sees a fault change (default: N)");
+
+/* Adaptive cache lifetimes. 0 means disabled. */
+#define HP_WMI_MAX_BACKOFF		16U
+
+static unsigned int adaptive_max_interval;
+module_param(adaptive_max_interval, uint, 0644);
+MODULE_PARM_DESC(adaptive_max_interval,
+		 "Longest cache lifetime in ms for stable sensors (default: 0 = not adaptive)");
+
+static unsigned int adaptive_deadband;
+module_param(adaptive_deadband, uint, 0644);
+MODULE_PARM_DESC(adaptive_deadband,
+		 "Change in percent below which a reading counts as stable (default: 0)");
+
+static unsigned int history_len;
+module_param(history_len, uint, 0444);
+MODULE_PARM_DESC(history_len,
+		 "Count of readings kept per channel for debugfs (default: 0 = none)");
+
+static bool slim;
+module_param(slim, bool, 0444);
+MODULE_PARM_DESC(slim,
+		 "Free data only needed for debugfs after probe (default: N)");
 
 enum hp_wmi_type {
 	HP_WMI_TYPE_OTHER			= 1,
@@ -178,14 +263,64 @@ static const enum hwmon_sensor_types hp_wmi_hwmon_type_map[] = {
 };
 
 static const u32 hp_wmi_hwmon_attributes[hwmon_max] = {
-	[hwmon_chip]	  = HWMON_C_REGISTER_TZ,
-	[hwmon_temp]	  = HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_FAULT,
-	[hwmon_in]	  = HWMON_I_INPUT | HWMON_I_LABEL,
-	[hwmon_curr]	  = HWMON_C_INPUT | HWMON_C_LABEL,
+	[hwmon_chip]	  = HWMON_C_REGISTER_TZ | HWMON_C_UPDATE_INTERVAL,
+	[hwmon_temp]	  = HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_FAULT |
+			    HWMON_T_LOWEST | HWMON_T_HIGHEST |
+			    HWMON_T_RESET_HISTORY,
+	[hwmon_in]	  = HWMON_I_INPUT | HWMON_I_LABEL | HWMON_I_AVERAGE |
+			    HWMON_I_LOWEST | HWMON_I_HIGHEST |
+			    HWMON_I_RESET_HISTORY,
+	[hwmon_curr]	  = HWMON_C_INPUT | HWMON_C_LABEL | HWMON_C_AVERAGE |
+			    HWMON_C_LOWEST | HWMON_C_HIGHEST |
+			    HWMON_C_RESET_HISTORY,
 	[hwmon_fan]	  = HWMON_F_INPUT | HWMON_F_LABEL | HWMON_F_FAULT,
 	[hwmon_intrusion] = HWMON_INTRUSION_ALARM,
 };
 
+enum hp_wmi_notify_kind {
+	HP_WMI_NOTIFY_ALARM,
+	HP_WMI_NOTIFY_FAULT,
+	HP_WMI_NOTIFY_MAX_ALARM,
+	HP_WMI_NOTIFY_CRIT_ALARM,
+	HP_WMI_NOTIFY_MIN_ALARM,
+	HP_WMI_NOTIFY_MAX,
+};
+
+static const u32 hp_wmi_notify_attrs[HP_WMI_NOTIFY_MAX][hwmon_max] = {
+	[HP_WMI_NOTIFY_ALARM] = {
+		[hwmon_temp]	  = hwmon_temp_alarm,
+		[hwmon_fan]	  = hwmon_fan_alarm,
+		[hwmon_intrusion] = hwmon_intrusion_alarm,
+	},
+	[HP_WMI_NOTIFY_FAULT] = {
+		[hwmon_temp]	  = hwmon_temp_fault,
+		[hwmon_fan]	  = hwmon_fan_fault,
+	},
+	[HP_WMI_NOTIFY_MAX_ALARM] = {
+		[hwmon_temp]	  = hwmon_temp_max_alarm,
+	},
+	[HP_WMI_NOTIFY_CRIT_ALARM] = {
+		[hwmon_temp]	  = hwmon_temp_crit_alarm,
+	},
+	[HP_WMI_NOTIFY_MIN_ALARM] = {
+		[hwmon_fan]	  = hwmon_fan_min_alarm,
+	},
+};
+
+/* Thresholds kept by the driver, each with an alarm flag of its own. */
+enum hp_wmi_limit_kind {
+	HP_WMI_LIMIT_TEMP_MAX,
+	HP_WMI_LIMIT_TEMP_CRIT,
+	HP_WMI_LIMIT_FAN_MIN,
+	HP_WMI_LIMIT_KINDS,
+};
+
+static const enum hp_wmi_notify_kind hp_wmi_limit_notify[HP_WMI_LIMIT_KINDS] = {
+	[HP_WMI_LIMIT_TEMP_MAX]	 = HP_WMI_NOTIFY_MAX_ALARM,
+	[HP_WMI_LIMIT_TEMP_CRIT] = HP_WMI_NOTIFY_CRIT_ALARM,
+	[HP_WMI_LIMIT_FAN_MIN]	 = HP_WMI_NOTIFY_MIN_ALARM,
+};
+
 /*
  * struct hp_wmi_numeric_sensor - a HPBIOS_BIOSNumericSensor instance
  *
@@ -261,7 +396,29 @@ static const u32 hp_wmi_hwmon_attributes[hwmon_max] = {
  *     [read] sint32 UnitModifier;
  *     [read] uint32 CurrentReading;
  *   };
+ *
+ * CurrentState must be one of PossibleStates[], so it is stored as an index.
+ * Should a BIOS initially report a CurrentState that is not, it is stored
+ * after the last element of PossibleStates[] instead.
+ */
+/*
+ * struct hp_wmi_scale - plan for scaling a numeric sensor reading for hwmon
+ * @unit_modifier: UnitModifier the plan was made for
+ * @divide: whether to divide rather than multiply by @factor
+ * @factor: power of ten by which to scale
+ * @bias: added before dividing to round as stepwise DIV_ROUND_CLOSEST() would
+ * @limit: largest reading that can be multiplied by @factor without overflow
+ *
+ * UnitModifier almost never changes, so a plan is made once and reused.
  */
+struct hp_wmi_scale {
+	s32 unit_modifier;
+	bool divide;
+	u64 factor;
+	u64 bias;
+	long limit;
+};
+
 struct hp_wmi_numeric_sensor {
 	const char *name;
 	const char *description;
@@ -270,11 +427,31 @@ struct hp_wmi_numeric_sensor {
 	u32 operational_status;
 	u8 size;			/* Count of PossibleStates[]. */
 	const char **possible_states;
-	const char *current_state;
+	u32 *possible_state_hashes;
+	u8 current_state;		/* Index into PossibleStates[]. */
 	u32 base_units;
 	s32 unit_modifier;
 	u32 current_reading;
 	u32 rate_units;
+	struct hp_wmi_scale scale;	/* Not a WMI property. */
+};
+
+/*
+ * struct hp_wmi_numeric_layout - element layout of a numeric sensor instance
+ * @elem_count: count of elements in the WMI object instance package
+ * @is_new: whether this is a "new" variant object
+ * @current_state: element index of CurrentState
+ * @unit_modifier: element index of UnitModifier
+ * @current_reading: element index of CurrentReading
+ *
+ * OperationalStatus is always at HP_WMI_PROPERTY_OPERATIONAL_STATUS.
+ */
+struct hp_wmi_numeric_layout {
+	u8 elem_count;
+	bool is_new;
+	u8 current_state;
+	u8 unit_modifier;
+	u8 current_reading;
 };
 
 /*
@@ -351,51 +528,279 @@ struct hp_wmi_platform_events {
  *   };
  */
 struct hp_wmi_event {
+	char name[HP_WMI_MAX_STR_SIZE];
+	char description[HP_WMI_MAX_STR_SIZE];
+	u32 category;
+};
+
+/*
+ * struct hp_wmi_raw_event - WMI event data awaiting decoding and dispatch
+ * @wobj: the event data, as returned by the WMI backend
+ * @pooled: whether @wobj is in a buffer from the event buffer pool, rather
+ *          than allocated by ACPI
+ */
+struct hp_wmi_raw_event {
+	union acpi_object *wobj;
+	bool pooled;
+};
+
+/*
+ * struct hp_wmi_route - event dispatch table entry
+ * @node: hashtable node
+ * @key: hash of event Name and Description
+ * @name: event Name
+ * @description: event Description
+ * @type: hwmon sensor type of the channels affected by the event
+ * @channels: bitmap of hwmon channels affected by the event
+ *
+ * Routes are built at probe from the HPBIOS_PlatformEvents instances that
+ * relate to hwmon channels, so that event notifications need no matching.
+ */
+struct hp_wmi_route {
+	struct hlist_node node;
+	u32 key;
 	const char *name;
 	const char *description;
-	u32 category;
+	enum hwmon_sensor_types type;
+	DECLARE_BITMAP(channels, HP_WMI_MAX_INSTANCES);
+};
+
+/*
+ * struct hp_wmi_reading - cached sensor reading
+ * @cached_val: current sensor reading value, scaled for hwmon
+ * @last_updated: when this reading was last updated
+ * @fault: fault flag, as of the last update
+ * @instance: WMI instance number of the sensor
+ * @type: hwmon sensor type of the sensor
+ * @backoff: log2 of the factor by which the cache lifetime is stretched
+ * @over_limits: bitmap of thresholds crossed as of the last update
+ * @has_history: whether any good reading was seen since the last reset
+ * @lowest: lowest value since the history was last reset
+ * @highest: highest value since the history was last reset
+ * @average: exponentially weighted moving average of values, fixed point
+ *
+ * Readings are kept apart from the rest of the sensor info, which is rarely
+ * needed after probe, in one array ordered by hwmon type and channel number.
+ * Readings of disconnected sensors follow those of all hwmon channels.
+ */
+struct hp_wmi_reading {
+	long cached_val;
+	unsigned long last_updated;	/* In jiffies. */
+	bool fault;
+	u8 instance;
+	u8 type;			/* enum hwmon_sensor_types */
+	u8 backoff;			/* See hp_wmi_adapt(). */
+	u8 over_limits;			/* See enum hp_wmi_limit_kind. */
+	bool has_history;
+	long lowest;
+	long highest;
+	long average;			/* In units of 1 / HP_WMI_EWMA_ONE. */
+};
+
+/*
+ * struct hp_wmi_limits - thresholds of a connected sensor
+ * @max: temperature max threshold, or 0 if disabled
+ * @crit: temperature critical threshold, or 0 if disabled
+ * @min: fan speed min threshold, or 0 if disabled
+ *
+ * Thresholds only change when written from sysfs, so they are kept out of
+ * the readings in an array of their own, indexed like the readings. They
+ * are written under the lock of the sensor's group and read locklessly.
+ */
+struct hp_wmi_limits {
+	long max;
+	long crit;
+	long min;
+};
+
+/*
+ * struct hp_wmi_stats - WMI query statistics for a sensor
+ * @hits: count of reads served from the cache
+ * @misses: count of reads that had to poll WMI
+ * @queries: count of WMI queries, including failed ones
+ * @errors: count of failed WMI queries
+ * @total_ns: total duration of WMI queries in nanoseconds
+ * @min_ns: duration of the fastest WMI query in nanoseconds
+ * @max_ns: duration of the slowest WMI query in nanoseconds
+ * @histogram: counts of WMI queries by duration, in log2(us) buckets
+ *
+ * Bucket 0 counts queries that took less than 1 us. Each bucket i after
+ * that counts queries that took [2^(i-1), 2^i) us, except that the last
+ * bucket is open-ended. Except for @hits and @misses, which are updated
+ * locklessly, members are protected by the lock of the sensor's group.
+ */
+struct hp_wmi_stats {
+	atomic_t hits;
+	atomic_t misses;
+	u32 queries;
+	u32 errors;
+	u64 total_ns;
+	u64 min_ns;
+	u64 max_ns;
+	u32 histogram[HP_WMI_STATS_BUCKETS];
+};
+
+/*
+ * struct hp_wmi_event_stats - WMI event statistics
+ * @received: count of event notifications received
+ * @decoded: count of events successfully decoded
+ * @coalesced: count of events collapsed into an identical preceding event
+ * @matched: count of dispatched events that raised at least one alarm
+ * @dropped: count of events dropped because the event queue was full
+ */
+struct hp_wmi_event_stats {
+	atomic_t received;
+	atomic_t decoded;
+	atomic_t coalesced;
+	atomic_t matched;
+	atomic_t dropped;
+};
+
+/*
+ * struct hp_wmi_sample - a historical sensor reading, as exported to debugfs
+ * @timestamp_ns: CLOCK_MONOTONIC time of the reading in nanoseconds
+ * @value: the reading, scaled for hwmon
+ * @operational_status: OperationalStatus as of the reading
+ * @type: hwmon sensor type
+ * @channel: hwmon channel number
+ */
+struct hp_wmi_sample {
+	u64 timestamp_ns;
+	s64 value;
+	u32 operational_status;
+	u8 type;
+	u8 channel;
+	u8 reserved[2];
+};
+
+/*
+ * struct hp_wmi_history - ring of historical sensor readings
+ * @samples: array of samples, as many as the history_len of the driver state
+ * @next: index of the sample to overwrite next
+ * @count: count of valid samples
+ */
+struct hp_wmi_history {
+	struct hp_wmi_sample *samples;
+	u32 next;
+	u32 count;
 };
 
 /*
  * struct hp_wmi_info - sensor info
  * @nsensor: numeric sensor properties
+ * @layout: element layout of its WMI object instance
+ * @reading: pointer to its cached reading
  * @instance: its WMI instance number
  * @state: pointer to driver state
- * @has_alarm: whether sensor has an alarm flag
- * @alarm: alarm flag
  * @type: its hwmon sensor type
- * @cached_val: current sensor reading value, scaled for hwmon
- * @last_updated: when these readings were last updated
+ * @stats: its WMI query statistics
+ * @raw: text dump of its last polled WMI object instance, for debugfs
+ * @raw_size: length of @raw
+ * @history: its recent readings, for debugfs
+ * @name_hash: hash of its Name as of probe, to recognize it later
+ * @verify: whether to check its Name against @name_hash on next refresh
+ * @mismatch: whether its instance was found to describe another sensor
+ *
+ * @verify and @mismatch are protected by the lock of the sensor's group.
  */
 struct hp_wmi_info {
 	struct hp_wmi_numeric_sensor nsensor;
+	struct hp_wmi_numeric_layout layout;
+	struct hp_wmi_reading *reading;
 	u8 instance;
 	void *state;			/* void *: Avoid forward declaration. */
-	bool has_alarm;
-	bool alarm;
 	enum hwmon_sensor_types type;
-	long cached_val;
-	unsigned long last_updated;	/* In jiffies. */
+	struct hp_wmi_stats stats;
+	char *raw;
+	size_t raw_size;
+	struct hp_wmi_history history;
+	u32 name_hash;
+	bool verify;
+	bool mismatch;
+};
+
+/*
+ * struct hp_wmi_group - refresh state for sensors of one hwmon type
+ * @scratch: reusable buffer for polling WMI object instances
+ * @lock: mutex to lock polling WMI for sensors of this type
+ * @seq: seqcount to publish cached readings of this type to lockless readers
+ *
+ * Disconnected sensors, which are only visible in debugfs, are grouped under
+ * hwmon_chip.
+ */
+struct hp_wmi_group {
+	struct acpi_buffer scratch;
 
+	struct mutex lock;	/* Lock polling WMI for this type. */
+	seqcount_mutex_t seq;	/* Publish readings. */
 };
 
 /*
  * struct hp_wmi_sensors - driver state
- * @wdev: pointer to the parent WMI device
- * @info_map: sensor info structs by hwmon type and channel number
+ * @dev: pointer to the parent WMI device, or the fake device (see hp_wmi_ops)
+ * @hwdev: pointer to the hwmon device, or NULL if not registered
+ * @info: sensor info structs by WMI instance number
+ * @readings: cached sensor readings, starting with those of connected sensors
+ * @limits: thresholds of connected sensors, indexed as for @readings
+ * @reading_map: cached sensor readings by hwmon type and channel number
  * @channel_count: count of hwmon channels by hwmon type
+ * @pevents: platform events objects, for debugfs
+ * @pcount: count of platform events objects
+ * @icount: count of sensors
+ * @count: count of connected sensors
  * @has_intrusion: whether an intrusion sensor is present
- * @intrusion: intrusion flag
- * @lock: mutex to lock polling WMI and changes to driver state
+ * @alarms: alarm flag bitmaps by hwmon type, indexed by channel number
+ * @limit_alarms: alarm flag bitmaps by threshold kind, as for @alarms
+ * @pending: pending notification bitmaps by kind, then as for @alarms
+ * @notify_work: work to send pending notifications
+ * @update_interval: sensor cache lifetime in milliseconds, unless overridden
+ * @history_len: count of readings kept per channel, clamped as of probe
+ * @poll_interval: background polling interval in jiffies, or 0 if disabled
+ * @poll_work: background polling work, or threshold checking work if disabled
+ * @groups: refresh state by hwmon type
+ * @event_bufs: pool of free buffers for WMI event data
+ * @events: queue of raw events awaiting decoding and dispatch
+ * @event_stats: WMI event statistics
+ * @event_lock: spinlock to serialize queueing events and taking buffers
+ * @event_work: work to dispatch queued events
+ * @routes: event dispatch table, keyed by hash of event Name and Description
+ * @resume_work: work to revalidate and refresh sensors after resume
+ * @resuming: bit 0 is set from resume until @resume_work has run
+ * @topology_changed: bit 0 is set once sensors are found changed since probe
  */
 struct hp_wmi_sensors {
-	struct wmi_device *wdev;
-	struct hp_wmi_info **info_map[hwmon_max];
-	u8 channel_count[hwmon_max];
+	struct device *dev;
+	struct device *hwdev;
+	struct hp_wmi_info *info;
+	struct hp_wmi_reading *readings;
+	struct hp_wmi_limits *limits;
+	struct hp_wmi_reading *reading_map[hwmon_max];
+	u16 channel_count[hwmon_max];
+	struct hp_wmi_platform_events *pevents;
+	u16 pcount;
+	u16 icount;
+	u16 count;
 	bool has_intrusion;
-	bool intrusion;
-
-	struct mutex lock;	/* Lock polling WMI and driver state changes. */
+	unsigned long alarms[hwmon_max][BITS_TO_LONGS(HP_WMI_MAX_INSTANCES)];
+	unsigned long limit_alarms[HP_WMI_LIMIT_KINDS]
+				  [BITS_TO_LONGS(HP_WMI_MAX_INSTANCES)];
+	unsigned long pending[HP_WMI_NOTIFY_MAX][hwmon_max]
+			     [BITS_TO_LONGS(HP_WMI_MAX_INSTANCES)];
+	struct work_struct notify_work;
+	unsigned int update_interval;
+	u32 history_len;
+	unsigned long poll_interval;
+	struct delayed_work poll_work;
+	struct hp_wmi_group groups[hwmon_max];
+	DECLARE_KFIFO(event_bufs, void *, HP_WMI_EVENT_QUEUE_LEN);
+	DECLARE_KFIFO(events, struct hp_wmi_raw_event, HP_WMI_EVENT_QUEUE_LEN);
+	struct hp_wmi_event_stats event_stats;
+	spinlock_t event_lock;	/* Serialize queueing events, taking buffers. */
+	struct work_struct event_work;
+	DECLARE_HASHTABLE(routes, HP_WMI_ROUTE_HASH_BITS);
+	struct work_struct resume_work;
+	unsigned long resuming;
+	unsigned long topology_changed;
 };
 
 static bool is_raw_wmi_string(const u8 *pointer, u32 length)
@@ -414,12 +819,12 @@ static bool is_raw_wmi_string(const u8 *pointer, u32 length)
 	return len <= length && !(len & 1);
 }
 
-static char *convert_raw_wmi_string(const u8 *buf)
+/* copy_raw_wmi_string - convert a raw WMI string into a caller buffer */
+static void copy_raw_wmi_string(const u8 *buf, char dst[HP_WMI_MAX_STR_SIZE])
 {
 	const wchar_t *src;
 	unsigned int cps;
 	unsigned int len;
-	char *dst;
 	int i;
 
 	src = (const wchar_t *)buf;
@@ -432,17 +837,51 @@ static char *convert_raw_wmi_string(const u8 *buf)
 	/* Each code point becomes up to 3 UTF-8 characters. */
 	len = min(cps * 3, HP_WMI_MAX_STR_SIZE - 1);
 
-	dst = kmalloc((len + 1) * sizeof(*dst), GFP_KERNEL);
+	i = utf16s_to_utf8s(++src, cps, UTF16_LITTLE_ENDIAN, dst, len);
+	dst[i] = '\0';
+}
+
+static char *convert_raw_wmi_string(const u8 *buf)
+{
+	char *dst;
+
+	dst = kmalloc(HP_WMI_MAX_STR_SIZE, GFP_KERNEL);
 	if (!dst)
 		return NULL;
 
-	i = utf16s_to_utf8s(++src, cps, UTF16_LITTLE_ENDIAN, dst, len);
-	dst[i] = '\0';
+	copy_raw_wmi_string(buf, dst);
 
 	return dst;
 }
 
-/* hp_wmi_strdup - devm_kstrdup, but length-limited */
+/*
+ * hp_wmi_kcalloc - devm_kcalloc(), or kcalloc() if @dev is NULL
+ *
+ * Sensor and platform events properties are normally managed by devres.
+ * Debugfs in slim mode rebuilds them only to show and discard them at once,
+ * which would just churn the devres list, so it passes a NULL @dev.
+ */
+static void *hp_wmi_kcalloc(struct device *dev, size_t n, size_t size)
+{
+	if (!dev)
+		return kcalloc(n, size, GFP_KERNEL);
+
+	return devm_kcalloc(dev, n, size, GFP_KERNEL);
+}
+
+/* hp_wmi_kfree - free memory from hp_wmi_kcalloc(); @p may be NULL */
+static void hp_wmi_kfree(struct device *dev, const void *p)
+{
+	if (!p)
+		return;
+
+	if (dev)
+		devm_kfree(dev, p);
+	else
+		kfree(p);
+}
+
+/* hp_wmi_strdup - devm_kstrdup, but length-limited; see hp_wmi_kcalloc() */
 static char *hp_wmi_strdup(struct device *dev, const char *src)
 {
 	char *dst;
@@ -450,7 +889,7 @@ static char *hp_wmi_strdup(struct device *dev, const char *src)
 
 	len = strnlen(src, HP_WMI_MAX_STR_SIZE - 1);
 
-	dst = devm_kmalloc(dev, (len + 1) * sizeof(*dst), GFP_KERNEL);
+	dst = hp_wmi_kcalloc(dev, len + 1, sizeof(*dst));
 	if (!dst)
 		return NULL;
 
@@ -476,847 +915,2849 @@ static char *hp_wmi_wstrdup(struct device *dev, const u8 *buf)
 	return dst;
 }
 
+/* hp_wmi_strfree - free strings from hp_wmi_[w]strdup() */
+static void hp_wmi_strfree(struct device *dev, const char *str)
+{
+	hp_wmi_kfree(dev, str);
+}
+
 /*
- * hp_wmi_get_wobj - poll WMI for a WMI object instance
- * @guid: WMI object GUID
- * @instance: WMI object instance number
+ * struct hp_wmi_backend - source of WMI object instances and events
+ * @query_block: poll WMI for a WMI object instance; see wmi_query_block()
+ * @get_event_data: get WMI event data; see wmi_get_event_data()
+ * @install_notify_handler: see wmi_install_notify_handler()
+ * @remove_notify_handler: see wmi_remove_notify_handler()
  *
- * Returns a new WMI object instance on success, or NULL on error.
- * Caller must kfree() the result.
+ * All firmware access goes through hp_wmi_ops, so that test builds may
+ * substitute a fake for the ACPI-WMI mapping driver.
  */
-static union acpi_object *hp_wmi_get_wobj(const char *guid, u8 instance)
-{
-	struct acpi_buffer out = { ACPI_ALLOCATE_BUFFER, NULL };
-	acpi_status err;
-
-	err = wmi_query_block(guid, instance, &out);
-	if (ACPI_FAILURE(err))
-		return NULL;
-
-	return out.pointer;
-}
+struct hp_wmi_backend {
+	acpi_status (*query_block)(const char *guid, u8 instance,
+				   struct acpi_buffer *out);
+	acpi_status (*get_event_data)(u32 value, struct acpi_buffer *out);
+	acpi_status (*install_notify_handler)(const char *guid,
+					      wmi_notify_handler handler,
+					      void *data);
+	acpi_status (*remove_notify_handler)(const char *guid);
+};
 
-/* hp_wmi_wobj_instance_count - find count of WMI object instances */
-static u8 hp_wmi_wobj_instance_count(const char *guid)
-{
-	u8 hi = HP_WMI_MAX_INSTANCES;
-	union acpi_object *wobj;
-	u8 lo = 0;
-	u8 mid;
+#ifndef HP_WMI_SENSORS_FAKE_WMI
 
-	while (lo < hi) {
-		mid = (lo + hi) / 2;
+static const struct hp_wmi_backend hp_wmi_acpi_backend = {
+	.query_block		= wmi_query_block,
+	.get_event_data		= wmi_get_event_data,
+	.install_notify_handler	= wmi_install_notify_handler,
+	.remove_notify_handler	= wmi_remove_notify_handler,
+};
 
-		wobj = hp_wmi_get_wobj(guid, mid);
-		if (!wobj) {
-			hi = mid;
-			continue;
-		}
+static const struct hp_wmi_backend *const hp_wmi_ops = &hp_wmi_acpi_backend;
 
-		lo = mid + 1;
-		kfree(wobj);
-	}
+#else /* HP_WMI_SENSORS_FAKE_WMI */
 
-	return lo;
-}
+/*
+ * Fake firmware for load testing without HP hardware.
+ *
+ * When built with -DHP_WMI_SENSORS_FAKE_WMI, the driver binds to a platform
+ * device of its own instead of a WMI device, and its firmware accesses are
+ * served from the scripts below. Readings vary from query to query. Writing
+ * N to the fake_event_storm parameter delivers N events in a row, cycling
+ * through hp_wmi_fake_events[].
+ */
 
-static int check_wobj(const union acpi_object *wobj,
-		      const acpi_object_type property_map[], int last_prop)
-{
-	acpi_object_type type = wobj->type;
-	acpi_object_type valid_type;
-	union acpi_object *elements;
-	u32 elem_count;
-	int prop;
+static unsigned int fake_sensors = UINT_MAX;
+module_param(fake_sensors, uint, 0444);
+MODULE_PARM_DESC(fake_sensors,
+		 "Count of fake sensors (default: all)");
 
-	if (type != ACPI_TYPE_PACKAGE)
-		return -EINVAL;
+static unsigned int fake_delay_us;
+module_param(fake_delay_us, uint, 0644);
+MODULE_PARM_DESC(fake_delay_us,
+		 "Fake firmware delay per WMI query in us (default: 0)");
 
-	elem_count = wobj->package.count;
-	if (elem_count != last_prop + 1)
-		return -EINVAL;
+struct hp_wmi_fake_sensor {
+	const char *name;
+	u32 sensor_type;
+	u32 base_units;
+	s32 unit_modifier;
+	u32 reading;			/* Lowest reading. */
+	u32 swing;			/* Count of distinct readings. */
+};
 
-	elements = wobj->package.elements;
-	for (prop = 0; prop <= last_prop; prop++) {
-		type = elements[prop].type;
-		valid_type = property_map[prop];
-		if (type != valid_type) {
-			if (type == ACPI_TYPE_BUFFER &&
-			    valid_type == ACPI_TYPE_STRING &&
-			    is_raw_wmi_string(elements[prop].buffer.pointer,
-					      elements[prop].buffer.length))
-				continue;
-			return -EINVAL;
-		}
-	}
+static const struct hp_wmi_fake_sensor hp_wmi_fake_sensors[] = {
+	{ "CPU0 Temperature", HP_WMI_TYPE_TEMPERATURE,
+	  HP_WMI_UNITS_DEGREES_C, 0, 45, 10 },
+	{ "CPU1 Temperature", HP_WMI_TYPE_TEMPERATURE,
+	  HP_WMI_UNITS_DEGREES_C, 0, 47, 10 },
+	{ "System Ambient Temperature", HP_WMI_TYPE_TEMPERATURE,
+	  HP_WMI_UNITS_DEGREES_F, 0, 77, 4 },
+	{ "CPU Fan", HP_WMI_TYPE_AIR_FLOW,
+	  HP_WMI_UNITS_RPM, 0, 1200, 400 },
+	{ "Rear Chassis Fan0", HP_WMI_TYPE_AIR_FLOW,
+	  HP_WMI_UNITS_RPM, 0, 900, 200 },
+	{ "12V Rail", HP_WMI_TYPE_VOLTAGE,
+	  HP_WMI_UNITS_VOLTS, -3, 12000, 50 },
+	{ "CPU Current", HP_WMI_TYPE_CURRENT,
+	  HP_WMI_UNITS_AMPS, -2, 500, 100 },
+};
 
-	return 0;
-}
+struct hp_wmi_fake_event {
+	const char *name;
+	const char *description;
+	u32 severity;
+	u32 status;
+};
 
-static int extract_acpi_value(struct device *dev,
-			      union acpi_object *element,
-			      acpi_object_type type,
-			      u32 *out_value, char **out_string)
-{
-	switch (type) {
-	case ACPI_TYPE_INTEGER:
-		*out_value = element->integer.value;
-		break;
+static const struct hp_wmi_fake_event hp_wmi_fake_events[] = {
+	{ "CPU Fan Stall", "CPU Fan Speed",
+	  HP_WMI_SEVERITY_CRITICAL_FAILURE, HP_WMI_STATUS_PREDICTIVE_FAILURE },
+	{ "Rear Chassis Fan0 Stall", "Rear Chassis Fan0 Speed",
+	  HP_WMI_SEVERITY_CRITICAL_FAILURE, HP_WMI_STATUS_PREDICTIVE_FAILURE },
+	{ HP_WMI_PATTERN_TEMP_ALARM, HP_WMI_PATTERN_CPU_TEMP,
+	  HP_WMI_SEVERITY_CRITICAL_FAILURE, HP_WMI_STATUS_STRESSED },
+	{ HP_WMI_PATTERN_INTRUSION_ALARM, HP_WMI_PATTERN_INTRUSION_ALARM,
+	  HP_WMI_SEVERITY_CRITICAL_FAILURE, HP_WMI_STATUS_OK },
+};
 
-	case ACPI_TYPE_STRING:
-		*out_string = element->type == ACPI_TYPE_BUFFER ?
-			hp_wmi_wstrdup(dev, element->buffer.pointer) :
-			hp_wmi_strdup(dev, strim(element->string.pointer));
-		if (!*out_string)
-			return -ENOMEM;
-		break;
+struct hp_wmi_fake_elem {
+	acpi_object_type type;
+	u64 integer;
+	const char *string;
+};
 
-	default:
-		return -EINVAL;
-	}
+#define HP_WMI_FAKE_INT(i)	{ .type = ACPI_TYPE_INTEGER, .integer = (i) }
+#define HP_WMI_FAKE_STR(s)	{ .type = ACPI_TYPE_STRING, .string = (s) }
 
-	return 0;
-}
+static DEFINE_MUTEX(hp_wmi_fake_lock);	/* Protects the handler. */
+static wmi_notify_handler hp_wmi_fake_handler;
+static void *hp_wmi_fake_context;
+static atomic_t hp_wmi_fake_ticks = ATOMIC_INIT(0);
 
 /*
- * check_numeric_sensor_wobj - validate a HPBIOS_BIOSNumericSensor instance
- * @wobj: pointer to WMI object instance to check
- * @out_size: out pointer to count of possible states
- * @out_is_new: out pointer to whether this is a "new" variant object
+ * hp_wmi_fake_package - build a WMI object instance as ACPICA would
+ * @elems: array of package elements
+ * @count: count of package elements
+ * @out: pointer to caller-allocated buffer, or with length
+ *       ACPI_ALLOCATE_BUFFER to allocate one
  *
- * Returns 0 on success, or a negative error code on error.
+ * Like ACPICA, returns AE_BUFFER_OVERFLOW and the required length in
+ * @out->length if a caller-allocated buffer is too small.
  */
-static int check_numeric_sensor_wobj(const union acpi_object *wobj,
-				     u8 *out_size, bool *out_is_new)
+static acpi_status hp_wmi_fake_package(const struct hp_wmi_fake_elem elems[],
+				       u32 count, struct acpi_buffer *out)
 {
-	acpi_object_type type = wobj->type;
-	int prop = HP_WMI_PROPERTY_NAME;
-	acpi_object_type valid_type;
 	union acpi_object *elements;
-	u32 elem_count;
-	int last_prop;
-	bool is_new;
-	u8 count;
-	u32 j;
+	union acpi_object *obj;
+	acpi_size length;
+	char *strings;
+	size_t len;
 	u32 i;
 
-	if (type != ACPI_TYPE_PACKAGE)
-		return -EINVAL;
+	length = (count + 1) * sizeof(*obj);
+	for (i = 0; i < count; i++)
+		if (elems[i].type == ACPI_TYPE_STRING)
+			length += strlen(elems[i].string) + 1;
+
+	if (out->length == ACPI_ALLOCATE_BUFFER) {
+		out->pointer = kzalloc(length, GFP_KERNEL);
+		if (!out->pointer)
+			return AE_NO_MEMORY;
+	} else if (out->length < length) {
+		out->length = length;
+		return AE_BUFFER_OVERFLOW;
+	}
 
-	/*
-	 * elements is a variable-length array of ACPI objects, one for
-	 * each property of the WMI object instance, except that the
-	 * strings in PossibleStates[] are flattened into this array
-	 * as if each individual string were a property by itself.
-	 */
-	elements = wobj->package.elements;
+	out->length = length;
 
-	elem_count = wobj->package.count;
-	if (elem_count <= HP_WMI_PROPERTY_SIZE ||
-	    elem_count > HP_WMI_MAX_PROPERTIES)
-		return -EINVAL;
+	obj = out->pointer;
+	elements = obj + 1;
+	strings = (char *)(elements + count);
 
-	type = elements[HP_WMI_PROPERTY_SIZE].type;
-	switch (type) {
-	case ACPI_TYPE_INTEGER:
-		is_new = true;
-		last_prop = HP_WMI_PROPERTY_RATE_UNITS;
-		break;
+	obj->package.type = ACPI_TYPE_PACKAGE;
+	obj->package.count = count;
+	obj->package.elements = elements;
 
-	case ACPI_TYPE_STRING:
-		is_new = false;
-		last_prop = HP_WMI_PROPERTY_CURRENT_READING;
-		break;
+	for (i = 0; i < count; i++) {
+		if (elems[i].type == ACPI_TYPE_INTEGER) {
+			elements[i].integer.type = ACPI_TYPE_INTEGER;
+			elements[i].integer.value = elems[i].integer;
+			continue;
+		}
 
-	default:
-		return -EINVAL;
+		len = strlen(elems[i].string);
+		memcpy(strings, elems[i].string, len + 1);
+
+		elements[i].string.type = ACPI_TYPE_STRING;
+		elements[i].string.length = len;
+		elements[i].string.pointer = strings;
+
+		strings += len + 1;
 	}
 
-	/*
-	 * In general, the count of PossibleStates[] must be > 0.
-	 * Also, the old variant lacks the Size property, so we may need to
-	 * reduce the value of last_prop by 1 when doing arithmetic with it.
-	 */
-	if (elem_count < last_prop - !is_new + 1)
-		return -EINVAL;
+	return AE_OK;
+}
 
-	count = elem_count - (last_prop - !is_new);
+static acpi_status hp_wmi_fake_sensor(u8 instance, struct acpi_buffer *out)
+{
+	const struct hp_wmi_fake_sensor *fake = &hp_wmi_fake_sensors[instance];
+	u32 tick = atomic_inc_return(&hp_wmi_fake_ticks);
+
+	/* New variant. */
+	struct hp_wmi_fake_elem elems[] = {
+		HP_WMI_FAKE_STR(fake->name),
+		HP_WMI_FAKE_STR(fake->name),
+		HP_WMI_FAKE_INT(fake->sensor_type),
+		HP_WMI_FAKE_STR(""),
+		HP_WMI_FAKE_INT(HP_WMI_STATUS_OK),
+		HP_WMI_FAKE_INT(1),
+		HP_WMI_FAKE_STR("Normal"),
+		HP_WMI_FAKE_STR("Normal"),
+		HP_WMI_FAKE_INT(fake->base_units),
+		HP_WMI_FAKE_INT((u32)fake->unit_modifier),
+		HP_WMI_FAKE_INT(fake->reading + tick % fake->swing),
+		HP_WMI_FAKE_INT(0),
+	};
+
+	return hp_wmi_fake_package(elems, ARRAY_SIZE(elems), out);
+}
 
-	for (i = 0; i < elem_count && prop <= last_prop; i++, prop++) {
-		type = elements[i].type;
-		valid_type = hp_wmi_property_map[prop];
-		if (type != valid_type)
-			return -EINVAL;
-
-		switch (prop) {
-		case HP_WMI_PROPERTY_OPERATIONAL_STATUS:
-			/* Old variant: CurrentState follows OperationalStatus. */
-			if (!is_new)
-				prop = HP_WMI_PROPERTY_CURRENT_STATE - 1;
-			break;
+static acpi_status hp_wmi_fake_platform_events(u8 instance,
+					       struct acpi_buffer *out)
+{
+	const struct hp_wmi_fake_event *fake = &hp_wmi_fake_events[instance];
+	struct hp_wmi_fake_elem elems[] = {
+		HP_WMI_FAKE_STR(fake->name),
+		HP_WMI_FAKE_STR(fake->description),
+		HP_WMI_FAKE_STR(HP_WMI_EVENT_NAMESPACE),
+		HP_WMI_FAKE_STR(HP_WMI_EVENT_CLASS),
+		HP_WMI_FAKE_INT(HP_WMI_CATEGORY_SENSOR),
+		HP_WMI_FAKE_INT(fake->severity),
+		HP_WMI_FAKE_INT(fake->status),
+	};
+
+	return hp_wmi_fake_package(elems, ARRAY_SIZE(elems), out);
+}
 
-		case HP_WMI_PROPERTY_SIZE:
-			/* New variant: Size == count of PossibleStates[]. */
-			if (count != elements[i].integer.value)
-				return -EINVAL;
-			break;
+static acpi_status hp_wmi_fake_query_block(const char *guid, u8 instance,
+					   struct acpi_buffer *out)
+{
+	u32 count;
 
-		case HP_WMI_PROPERTY_POSSIBLE_STATES:
-			/* PossibleStates[0] has already been type-checked. */
-			for (j = 0; i + 1 < elem_count && j + 1 < count; j++) {
-				type = elements[++i].type;
-				if (type != valid_type)
-					return -EINVAL;
-			}
+	if (fake_delay_us)
+		fsleep(fake_delay_us);
 
-			/* Old variant: BaseUnits follows PossibleStates[]. */
-			if (!is_new)
-				prop = HP_WMI_PROPERTY_BASE_UNITS - 1;
-			break;
+	if (!strcmp(guid, HP_WMI_NUMERIC_SENSOR_GUID)) {
+		count = min_t(u32, fake_sensors,
+			      ARRAY_SIZE(hp_wmi_fake_sensors));
+		if (instance >= count)
+			return AE_BAD_PARAMETER;
 
-		case HP_WMI_PROPERTY_CURRENT_STATE:
-			/* Old variant: PossibleStates[] follows CurrentState. */
-			if (!is_new)
-				prop = HP_WMI_PROPERTY_POSSIBLE_STATES - 1;
-			break;
-		}
+		return hp_wmi_fake_sensor(instance, out);
 	}
 
-	if (prop != last_prop + 1)
-		return -EINVAL;
+	if (!strcmp(guid, HP_WMI_PLATFORM_EVENTS_GUID)) {
+		if (instance >= ARRAY_SIZE(hp_wmi_fake_events))
+			return AE_BAD_PARAMETER;
 
-	*out_size = count;
-	*out_is_new = is_new;
+		return hp_wmi_fake_platform_events(instance, out);
+	}
 
-	return 0;
+	return AE_NOT_FOUND;
 }
 
-static int
-numeric_sensor_is_connected(const struct hp_wmi_numeric_sensor *nsensor)
+static acpi_status hp_wmi_fake_event(u32 index, struct acpi_buffer *out)
 {
-	u32 operational_status = nsensor->operational_status;
+	const struct hp_wmi_fake_event *fake = &hp_wmi_fake_events[index];
+	struct hp_wmi_fake_elem elems[] = {
+		HP_WMI_FAKE_STR(fake->name),
+		HP_WMI_FAKE_STR(fake->description),
+		HP_WMI_FAKE_INT(HP_WMI_CATEGORY_SENSOR),
+		HP_WMI_FAKE_INT(fake->severity),
+		HP_WMI_FAKE_INT(fake->status),
+	};
+
+	return hp_wmi_fake_package(elems, ARRAY_SIZE(elems), out);
+}
 
-	return operational_status != HP_WMI_STATUS_NO_CONTACT;
+/* The notification value is used as an index into hp_wmi_fake_events[]. */
+static acpi_status hp_wmi_fake_get_event_data(u32 value,
+					      struct acpi_buffer *out)
+{
+	if (value >= ARRAY_SIZE(hp_wmi_fake_events))
+		return AE_BAD_PARAMETER;
+
+	return hp_wmi_fake_event(value, out);
 }
 
-static int numeric_sensor_has_fault(const struct hp_wmi_numeric_sensor *nsensor)
+static acpi_status
+hp_wmi_fake_install_notify_handler(const char *guid,
+				   wmi_notify_handler handler, void *data)
 {
-	u32 operational_status = nsensor->operational_status;
+	acpi_status ret = AE_OK;
 
-	switch (operational_status) {
-	case HP_WMI_STATUS_DEGRADED:
-	case HP_WMI_STATUS_STRESSED:		/* e.g. Overload, overtemp. */
-	case HP_WMI_STATUS_PREDICTIVE_FAILURE:	/* e.g. Fan removed. */
-	case HP_WMI_STATUS_ERROR:
-	case HP_WMI_STATUS_NON_RECOVERABLE_ERROR:
-	case HP_WMI_STATUS_NO_CONTACT:
-	case HP_WMI_STATUS_LOST_COMMUNICATION:
-	case HP_WMI_STATUS_ABORTED:
-	case HP_WMI_STATUS_SUPPORTING_ENTITY_IN_ERROR:
+	if (strcmp(guid, HP_WMI_EVENT_GUID))
+		return AE_NOT_EXIST;
 
-	/* Assume combination by addition; bitwise OR doesn't make sense. */
-	case HP_WMI_STATUS_COMPLETED + HP_WMI_STATUS_DEGRADED:
-	case HP_WMI_STATUS_COMPLETED + HP_WMI_STATUS_ERROR:
-		return true;
+	mutex_lock(&hp_wmi_fake_lock);
+
+	if (hp_wmi_fake_handler) {
+		ret = AE_ALREADY_ACQUIRED;
+	} else {
+		hp_wmi_fake_handler = handler;
+		hp_wmi_fake_context = data;
 	}
 
-	return false;
+	mutex_unlock(&hp_wmi_fake_lock);
+
+	return ret;
 }
 
-/* scale_numeric_sensor - scale sensor reading for hwmon */
-static long scale_numeric_sensor(const struct hp_wmi_numeric_sensor *nsensor)
+static acpi_status hp_wmi_fake_remove_notify_handler(const char *guid)
 {
-	u32 current_reading = nsensor->current_reading;
-	s32 unit_modifier = nsensor->unit_modifier;
-	u32 sensor_type = nsensor->sensor_type;
-	u32 base_units = nsensor->base_units;
-	s32 target_modifier;
-	long val;
+	mutex_lock(&hp_wmi_fake_lock);
+	hp_wmi_fake_handler = NULL;
+	hp_wmi_fake_context = NULL;
+	mutex_unlock(&hp_wmi_fake_lock);
 
-	/* Fan readings are in RPM units; others are in milliunits. */
-	target_modifier = sensor_type == HP_WMI_TYPE_AIR_FLOW ? 0 : -3;
+	return AE_OK;
+}
 
-	val = current_reading;
+static const struct hp_wmi_backend hp_wmi_fake_backend = {
+	.query_block		= hp_wmi_fake_query_block,
+	.get_event_data		= hp_wmi_fake_get_event_data,
+	.install_notify_handler	= hp_wmi_fake_install_notify_handler,
+	.remove_notify_handler	= hp_wmi_fake_remove_notify_handler,
+};
 
-	for (; unit_modifier < target_modifier; unit_modifier++)
-		val = DIV_ROUND_CLOSEST(val, 10);
+static const struct hp_wmi_backend *const hp_wmi_ops = &hp_wmi_fake_backend;
 
-	for (; unit_modifier > target_modifier; unit_modifier--) {
-		if (val > LONG_MAX / 10) {
-			val = LONG_MAX;
-			break;
-		}
-		val *= 10;
-	}
+/* Deliver as many events as written, one after another. */
+static int hp_wmi_fake_event_storm(const char *val,
+				   const struct kernel_param *kp)
+{
+	unsigned int count;
+	unsigned int i;
+	int err;
 
-	if (sensor_type == HP_WMI_TYPE_TEMPERATURE) {
-		switch (base_units) {
-		case HP_WMI_UNITS_DEGREES_F:
-			val -= MILLI * 32;
-			val = val <= LONG_MAX / 5 ?
-				      DIV_ROUND_CLOSEST(val * 5, 9) :
-				      DIV_ROUND_CLOSEST(val, 9) * 5;
-			break;
+	err = kstrtouint(val, 0, &count);
+	if (err)
+		return err;
 
-		case HP_WMI_UNITS_DEGREES_K:
-			val = milli_kelvin_to_millicelsius(val);
-			break;
-		}
+	mutex_lock(&hp_wmi_fake_lock);
+
+	if (hp_wmi_fake_handler)
+		for (i = 0; i < count; i++)
+			hp_wmi_fake_handler(i % ARRAY_SIZE(hp_wmi_fake_events),
+					    hp_wmi_fake_context);
+	else
+		err = -ENODEV;
+
+	mutex_unlock(&hp_wmi_fake_lock);
+
+	return err;
+}
+
+static const struct kernel_param_ops hp_wmi_fake_event_storm_ops = {
+	.set = hp_wmi_fake_event_storm,
+};
+
+module_param_cb(fake_event_storm, &hp_wmi_fake_event_storm_ops, NULL, 0200);
+MODULE_PARM_DESC(fake_event_storm, "Write N to deliver N fake WMI events");
+
+#endif /* HP_WMI_SENSORS_FAKE_WMI */
+
+/*
+ * hp_wmi_query_wobj - poll WMI for a WMI object instance
+ * @guid: WMI object GUID
+ * @instance: WMI object instance number
+ * @out: pointer to buffer to receive the new WMI object instance
+ *
+ * Returns true on success, or false on error. On success, @out->length
+ * is the length of the result in bytes. Caller must kfree() the result.
+ */
+static bool hp_wmi_query_wobj(const char *guid, u8 instance,
+			      struct acpi_buffer *out)
+{
+	acpi_status err;
+
+	out->length = ACPI_ALLOCATE_BUFFER;
+	out->pointer = NULL;
+
+	err = hp_wmi_ops->query_block(guid, instance, out);
+	if (ACPI_FAILURE(err)) {
+		out->length = 0;
+		out->pointer = NULL;
+		return false;
 	}
 
-	return val;
+	return true;
 }
 
 /*
- * classify_numeric_sensor - classify a numeric sensor
- * @nsensor: pointer to numeric sensor struct
+ * hp_wmi_wobj_instance_count - find count of WMI object instances
+ * @guid: WMI object GUID
+ * @wobjs: array of HP_WMI_MAX_INSTANCES buffers for instances found
  *
- * Returns an enum hp_wmi_type value on success,
- * or a negative value if the sensor type is unsupported.
+ * Instances are assumed to be numbered contiguously from 0. Instances
+ * 0, 1, 3, 7, ... are probed until one is missing, then the count is found
+ * by binary search between the last instance found and the missing one.
+ * This takes O(log n) queries for n instances, so systems with only a few
+ * instances are not penalized by the high ceiling.
+ *
+ * Instances polled during the search are kept in @wobjs, indexed by
+ * instance number, so that they need not be polled again. Entries for
+ * instances that were not polled are left empty.
  */
-static int classify_numeric_sensor(const struct hp_wmi_numeric_sensor *nsensor)
+static u16 hp_wmi_wobj_instance_count(const char *guid,
+				      struct acpi_buffer wobjs[])
 {
-	u32 sensor_type = nsensor->sensor_type;
-	u32 base_units = nsensor->base_units;
-	const char *name = nsensor->name;
+	u16 hi = HP_WMI_MAX_INSTANCES;
+	u16 lo = 0;
+	u16 bound;
+	u16 mid;
+
+	for (bound = 1; bound <= HP_WMI_MAX_INSTANCES; bound *= 2) {
+		if (!hp_wmi_query_wobj(guid, bound - 1, &wobjs[bound - 1])) {
+			hi = bound - 1;
+			break;
+		}
 
-	switch (sensor_type) {
-	case HP_WMI_TYPE_TEMPERATURE:
-		/*
-		 * Some systems have sensors named "X Thermal Index" in "Other"
-		 * units. Tested CPU sensor examples were found to be in °C,
-		 * albeit perhaps "differently" accurate; e.g. readings were
-		 * reliably -6°C vs. coretemp on a HP Compaq Elite 8300, and
-		 * +8°C on an EliteOne G1 800. But this is still within the
-		 * realm of plausibility for cheaply implemented motherboard
-		 * sensors, and chassis readings were about as expected.
-		 */
-		if ((base_units == HP_WMI_UNITS_OTHER &&
-		     strstr(name, HP_WMI_PATTERN_TEMP_SENSOR)) ||
-		    base_units == HP_WMI_UNITS_DEGREES_C ||
-		    base_units == HP_WMI_UNITS_DEGREES_F ||
-		    base_units == HP_WMI_UNITS_DEGREES_K)
-			return HP_WMI_TYPE_TEMPERATURE;
-		break;
+		lo = bound;
+	}
 
-	case HP_WMI_TYPE_VOLTAGE:
-		if (base_units == HP_WMI_UNITS_VOLTS)
-			return HP_WMI_TYPE_VOLTAGE;
-		break;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
 
-	case HP_WMI_TYPE_CURRENT:
-		if (base_units == HP_WMI_UNITS_AMPS)
-			return HP_WMI_TYPE_CURRENT;
-		break;
+		if (!hp_wmi_query_wobj(guid, mid, &wobjs[mid])) {
+			hi = mid;
+			continue;
+		}
 
-	case HP_WMI_TYPE_AIR_FLOW:
-		/*
-		 * Strangely, HP considers fan RPM sensor type to be
-		 * "Air Flow" instead of the more intuitive "Tachometer".
-		 */
-		if (base_units == HP_WMI_UNITS_RPM)
-			return HP_WMI_TYPE_AIR_FLOW;
-		break;
+		lo = mid + 1;
 	}
 
-	return -EINVAL;
+	return lo;
 }
 
-static int
-populate_numeric_sensor_from_wobj(struct device *dev,
-				  struct hp_wmi_numeric_sensor *nsensor,
-				  union acpi_object *wobj, bool *out_is_new)
+/*
+ * hp_wmi_get_wobjs - poll WMI for all instances of a WMI object
+ * @guid: WMI object GUID
+ * @out_wobjs: out pointer to array of HP_WMI_MAX_INSTANCES buffers holding
+ *             the instances
+ *
+ * Each instance is polled at most once, including while searching for the
+ * count of instances.
+ *
+ * Returns the count of instances on success, or a negative error code on
+ * error. Caller must release @out_wobjs with hp_wmi_put_wobjs() in either
+ * case.
+ */
+static int hp_wmi_get_wobjs(const char *guid, struct acpi_buffer **out_wobjs)
 {
-	int last_prop = HP_WMI_PROPERTY_RATE_UNITS;
-	int prop = HP_WMI_PROPERTY_NAME;
-	const char **possible_states;
-	union acpi_object *element;
-	acpi_object_type type;
-	char *string;
-	bool is_new;
-	u32 value;
-	u8 size;
-	int err;
+	struct acpi_buffer *wobjs;
+	u16 count;
+	u16 i;
+
+	/* Too big for the stack with HP_WMI_MAX_INSTANCES entries. */
+	wobjs = kcalloc(HP_WMI_MAX_INSTANCES, sizeof(*wobjs), GFP_KERNEL);
+	*out_wobjs = wobjs;
+	if (!wobjs)
+		return -ENOMEM;
 
-	err = check_numeric_sensor_wobj(wobj, &size, &is_new);
-	if (err)
-		return err;
+	count = hp_wmi_wobj_instance_count(guid, wobjs);
 
-	possible_states = devm_kcalloc(dev, size, sizeof(*possible_states),
-				       GFP_KERNEL);
-	if (!possible_states)
-		return -ENOMEM;
+	for (i = 0; i < count; i++) {
+		if (wobjs[i].pointer)
+			continue;
 
-	element = wobj->package.elements;
-	nsensor->possible_states = possible_states;
-	nsensor->size = size;
+		if (!hp_wmi_query_wobj(guid, i, &wobjs[i]))
+			return -EIO;
+	}
 
-	if (!is_new)
-		last_prop = HP_WMI_PROPERTY_CURRENT_READING;
+	return count;
+}
 
-	for (; prop <= last_prop; prop++) {
-		type = hp_wmi_property_map[prop];
+/* hp_wmi_put_wobjs - release instances obtained with hp_wmi_get_wobjs() */
+static void hp_wmi_put_wobjs(struct acpi_buffer *wobjs)
+{
+	u16 i;
 
-		err = extract_acpi_value(dev, element, type, &value, &string);
-		if (err)
-			return err;
+	if (!wobjs)
+		return;
 
-		element++;
+	for (i = 0; i < HP_WMI_MAX_INSTANCES; i++)
+		kfree(wobjs[i].pointer);
 
-		switch (prop) {
-		case HP_WMI_PROPERTY_NAME:
-			nsensor->name = string;
-			break;
+	kfree(wobjs);
+}
 
-		case HP_WMI_PROPERTY_DESCRIPTION:
-			nsensor->description = string;
-			break;
+/*
+ * hp_wmi_grow_scratch - grow a reusable buffer for ACPI objects
+ * @dev: pointer to device
+ * @scratch: pointer to reusable buffer
+ * @length: minimum length
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int hp_wmi_grow_scratch(struct device *dev, struct acpi_buffer *scratch,
+			       acpi_size length)
+{
+	void *pointer;
 
-		case HP_WMI_PROPERTY_SENSOR_TYPE:
-			if (value > HP_WMI_TYPE_AIR_FLOW)
-				return -EINVAL;
+	if (scratch->length >= length)
+		return 0;
 
-			nsensor->sensor_type = value;
-			break;
+	pointer = devm_krealloc(dev, scratch->pointer, length, GFP_KERNEL);
+	if (!pointer)
+		return -ENOMEM;
 
-		case HP_WMI_PROPERTY_OTHER_SENSOR_TYPE:
-			nsensor->other_sensor_type = string;
-			break;
+	scratch->pointer = pointer;
+	scratch->length = length;
 
-		case HP_WMI_PROPERTY_OPERATIONAL_STATUS:
-			nsensor->operational_status = value;
+	return 0;
+}
 
-			/* Old variant: CurrentState follows OperationalStatus. */
-			if (!is_new)
-				prop = HP_WMI_PROPERTY_CURRENT_STATE - 1;
-			break;
+/*
+ * hp_wmi_get_wobj_scratch - poll WMI for a WMI object instance into a buffer
+ * @dev: pointer to device
+ * @guid: WMI object GUID
+ * @instance: WMI object instance number
+ * @scratch: pointer to reusable buffer, grown if too small
+ *
+ * Returns a WMI object instance stored in @scratch on success, or NULL on
+ * error. The result is only valid until @scratch is reused; do not kfree() it.
+ */
+static union acpi_object *
+hp_wmi_get_wobj_scratch(struct device *dev, const char *guid, u8 instance,
+			struct acpi_buffer *scratch)
+{
+	struct acpi_buffer out = *scratch;
+	acpi_status err;
 
-		case HP_WMI_PROPERTY_SIZE:
-			break;			/* Already set. */
+	err = hp_wmi_ops->query_block(guid, instance, &out);
+	if (err == AE_BUFFER_OVERFLOW) {
+		/* out.length is now the required length. */
+		if (hp_wmi_grow_scratch(dev, scratch, out.length))
+			return NULL;
+
+		out = *scratch;
+		err = hp_wmi_ops->query_block(guid, instance, &out);
+	}
+	if (ACPI_FAILURE(err))
+		return NULL;
+
+	return out.pointer;
+}
+
+static int check_wobj(const union acpi_object *wobj,
+		      const acpi_object_type property_map[], int last_prop)
+{
+	acpi_object_type type = wobj->type;
+	acpi_object_type valid_type;
+	union acpi_object *elements;
+	u32 elem_count;
+	int prop;
+
+	if (type != ACPI_TYPE_PACKAGE)
+		return -EINVAL;
+
+	elem_count = wobj->package.count;
+	if (elem_count != last_prop + 1)
+		return -EINVAL;
+
+	elements = wobj->package.elements;
+	for (prop = 0; prop <= last_prop; prop++) {
+		type = elements[prop].type;
+		valid_type = property_map[prop];
+		if (type != valid_type) {
+			if (type == ACPI_TYPE_BUFFER &&
+			    valid_type == ACPI_TYPE_STRING &&
+			    is_raw_wmi_string(elements[prop].buffer.pointer,
+					      elements[prop].buffer.length))
+				continue;
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int extract_acpi_value(struct device *dev,
+			      union acpi_object *element,
+			      acpi_object_type type,
+			      u32 *out_value, char **out_string)
+{
+	switch (type) {
+	case ACPI_TYPE_INTEGER:
+		*out_value = element->integer.value;
+		break;
+
+	case ACPI_TYPE_STRING:
+		*out_string = element->type == ACPI_TYPE_BUFFER ?
+			hp_wmi_wstrdup(dev, element->buffer.pointer) :
+			hp_wmi_strdup(dev, strim(element->string.pointer));
+		if (!*out_string)
+			return -ENOMEM;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * extract_acpi_string - copy a string value without allocating memory
+ * @element: pointer to ACPI object of type string, or raw WMI string buffer
+ * @dst: destination buffer, which receives a trimmed copy
+ */
+static void extract_acpi_string(const union acpi_object *element,
+				char dst[HP_WMI_MAX_STR_SIZE])
+{
+	char buf[HP_WMI_MAX_STR_SIZE];
+
+	if (element->type == ACPI_TYPE_BUFFER)
+		copy_raw_wmi_string(element->buffer.pointer, buf);
+	else
+		strscpy(buf, element->string.pointer, sizeof(buf));
+
+	strscpy(dst, strim(buf), HP_WMI_MAX_STR_SIZE);
+}
+
+/*
+ * serialize_wobj - dump a WMI object instance as text
+ * @wobj: pointer to WMI object instance, which need not be valid
+ * @buf: buffer to receive the dump
+ * @size: size of @buf in bytes
+ *
+ * Returns the length of the dump, which is truncated to fit in @buf.
+ */
+static size_t serialize_wobj(const union acpi_object *wobj, char *buf,
+			     size_t size)
+{
+	char str[HP_WMI_MAX_STR_SIZE];
+	const union acpi_object *element;
+	size_t len = 0;
+	u32 i;
+
+	if (wobj->type != ACPI_TYPE_PACKAGE)
+		return scnprintf(buf, size, "(ACPI type %d)\n", wobj->type);
+
+	for (i = 0; i < wobj->package.count; i++) {
+		element = &wobj->package.elements[i];
+
+		switch (element->type) {
+		case ACPI_TYPE_INTEGER:
+			len += scnprintf(buf + len, size - len, "%u: %llu\n",
+					 i, element->integer.value);
+			break;
+
+		case ACPI_TYPE_STRING:
+			len += scnprintf(buf + len, size - len, "%u: \"%s\"\n",
+					 i, element->string.pointer);
+			break;
+
+		case ACPI_TYPE_BUFFER:
+			if (!is_raw_wmi_string(element->buffer.pointer,
+					       element->buffer.length)) {
+				len += scnprintf(buf + len, size - len,
+						 "%u: (%u-byte buffer)\n", i,
+						 element->buffer.length);
+				break;
+			}
+
+			copy_raw_wmi_string(element->buffer.pointer, str);
+			len += scnprintf(buf + len, size - len, "%u: \"%s\"\n",
+					 i, str);
+			break;
+
+		default:
+			len += scnprintf(buf + len, size - len,
+					 "%u: (ACPI type %d)\n", i,
+					 element->type);
+			break;
+		}
+	}
+
+	return len;
+}
+
+/*
+ * check_numeric_sensor_wobj - validate a HPBIOS_BIOSNumericSensor instance
+ * @wobj: pointer to WMI object instance to check
+ * @out_size: out pointer to count of possible states
+ * @out_is_new: out pointer to whether this is a "new" variant object
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int check_numeric_sensor_wobj(const union acpi_object *wobj,
+				     u8 *out_size, bool *out_is_new)
+{
+	acpi_object_type type = wobj->type;
+	int prop = HP_WMI_PROPERTY_NAME;
+	acpi_object_type valid_type;
+	union acpi_object *elements;
+	u32 elem_count;
+	int last_prop;
+	bool is_new;
+	u8 count;
+	u32 j;
+	u32 i;
+
+	if (type != ACPI_TYPE_PACKAGE)
+		return -EINVAL;
+
+	/*
+	 * elements is a variable-length array of ACPI objects, one for
+	 * each property of the WMI object instance, except that the
+	 * strings in PossibleStates[] are flattened into this array
+	 * as if each individual string were a property by itself.
+	 */
+	elements = wobj->package.elements;
+
+	elem_count = wobj->package.count;
+	if (elem_count <= HP_WMI_PROPERTY_SIZE ||
+	    elem_count > HP_WMI_MAX_PROPERTIES)
+		return -EINVAL;
+
+	type = elements[HP_WMI_PROPERTY_SIZE].type;
+	switch (type) {
+	case ACPI_TYPE_INTEGER:
+		is_new = true;
+		last_prop = HP_WMI_PROPERTY_RATE_UNITS;
+		break;
+
+	case ACPI_TYPE_STRING:
+		is_new = false;
+		last_prop = HP_WMI_PROPERTY_CURRENT_READING;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	/*
+	 * In general, the count of PossibleStates[] must be > 0.
+	 * Also, the old variant lacks the Size property, so we may need to
+	 * reduce the value of last_prop by 1 when doing arithmetic with it.
+	 */
+	if (elem_count < last_prop - !is_new + 1)
+		return -EINVAL;
+
+	count = elem_count - (last_prop - !is_new);
+
+	for (i = 0; i < elem_count && prop <= last_prop; i++, prop++) {
+		type = elements[i].type;
+		valid_type = hp_wmi_property_map[prop];
+		if (type != valid_type)
+			return -EINVAL;
+
+		switch (prop) {
+		case HP_WMI_PROPERTY_OPERATIONAL_STATUS:
+			/* Old variant: CurrentState follows OperationalStatus. */
+			if (!is_new)
+				prop = HP_WMI_PROPERTY_CURRENT_STATE - 1;
+			break;
+
+		case HP_WMI_PROPERTY_SIZE:
+			/* New variant: Size == count of PossibleStates[]. */
+			if (count != elements[i].integer.value)
+				return -EINVAL;
+			break;
 
 		case HP_WMI_PROPERTY_POSSIBLE_STATES:
-			*possible_states++ = string;
-			if (--size)
-				prop--;
+			/* PossibleStates[0] has already been type-checked. */
+			for (j = 0; i + 1 < elem_count && j + 1 < count; j++) {
+				type = elements[++i].type;
+				if (type != valid_type)
+					return -EINVAL;
+			}
+
+			/* Old variant: BaseUnits follows PossibleStates[]. */
+			if (!is_new)
+				prop = HP_WMI_PROPERTY_BASE_UNITS - 1;
+			break;
+
+		case HP_WMI_PROPERTY_CURRENT_STATE:
+			/* Old variant: PossibleStates[] follows CurrentState. */
+			if (!is_new)
+				prop = HP_WMI_PROPERTY_POSSIBLE_STATES - 1;
+			break;
+		}
+	}
+
+	if (prop != last_prop + 1)
+		return -EINVAL;
+
+	*out_size = count;
+	*out_is_new = is_new;
+
+	return 0;
+}
+
+/*
+ * make_numeric_layout - compute the element layout of a numeric sensor
+ * @layout: pointer to layout struct to fill
+ * @wobj: pointer to WMI object instance already validated by
+ *        check_numeric_sensor_wobj()
+ * @size: count of possible states
+ * @is_new: whether this is a "new" variant object
+ */
+static void make_numeric_layout(struct hp_wmi_numeric_layout *layout,
+				const union acpi_object *wobj,
+				u8 size, bool is_new)
+{
+	int offset;
+
+	layout->elem_count = wobj->package.count;
+	layout->is_new = is_new;
+
+	/*
+	 * In general, an index offset is needed after PossibleStates[0].
+	 * On a new variant, CurrentState is after PossibleStates[]. This is
+	 * not the case on an old variant, but we still need to offset the
+	 * read because CurrentState is where Size would be on a new variant.
+	 */
+	offset = is_new ? size - 1 : -2;
+
+	layout->current_state = HP_WMI_PROPERTY_CURRENT_STATE + offset;
+
+	/* Old variant: -2 (not -1) because it lacks the Size property. */
+	if (!is_new)
+		offset = (int)size - 2;	/* size is > 0, i.e. may be 1. */
+
+	layout->unit_modifier = HP_WMI_PROPERTY_UNIT_MODIFIER + offset;
+	layout->current_reading = HP_WMI_PROPERTY_CURRENT_READING + offset;
+}
+
+/*
+ * numeric_layout_matches - quickly check a numeric sensor against a layout
+ * @layout: pointer to layout struct of a previously validated instance
+ * @wobj: pointer to WMI object instance to check
+ *
+ * Only checks the package shape and the types of the fungible properties,
+ * which is enough to safely read them. Use check_numeric_sensor_wobj()
+ * to fully validate an instance.
+ */
+static bool numeric_layout_matches(const struct hp_wmi_numeric_layout *layout,
+				   const union acpi_object *wobj)
+{
+	const union acpi_object *elements;
+
+	if (wobj->type != ACPI_TYPE_PACKAGE ||
+	    wobj->package.count != layout->elem_count)
+		return false;
+
+	elements = wobj->package.elements;
+
+	return elements[HP_WMI_PROPERTY_OPERATIONAL_STATUS].type ==
+		       ACPI_TYPE_INTEGER &&
+	       elements[layout->current_state].type == ACPI_TYPE_STRING &&
+	       elements[layout->unit_modifier].type == ACPI_TYPE_INTEGER &&
+	       elements[layout->current_reading].type == ACPI_TYPE_INTEGER;
+}
+
+static int
+numeric_sensor_is_connected(const struct hp_wmi_numeric_sensor *nsensor)
+{
+	u32 operational_status = nsensor->operational_status;
+
+	return operational_status != HP_WMI_STATUS_NO_CONTACT;
+}
+
+static int numeric_sensor_has_fault(const struct hp_wmi_numeric_sensor *nsensor)
+{
+	u32 operational_status = nsensor->operational_status;
+
+	switch (operational_status) {
+	case HP_WMI_STATUS_DEGRADED:
+	case HP_WMI_STATUS_STRESSED:		/* e.g. Overload, overtemp. */
+	case HP_WMI_STATUS_PREDICTIVE_FAILURE:	/* e.g. Fan removed. */
+	case HP_WMI_STATUS_ERROR:
+	case HP_WMI_STATUS_NON_RECOVERABLE_ERROR:
+	case HP_WMI_STATUS_NO_CONTACT:
+	case HP_WMI_STATUS_LOST_COMMUNICATION:
+	case HP_WMI_STATUS_ABORTED:
+	case HP_WMI_STATUS_SUPPORTING_ENTITY_IN_ERROR:
+
+	/* Assume combination by addition; bitwise OR doesn't make sense. */
+	case HP_WMI_STATUS_COMPLETED + HP_WMI_STATUS_DEGRADED:
+	case HP_WMI_STATUS_COMPLETED + HP_WMI_STATUS_ERROR:
+		return true;
+	}
+
+	return false;
+}
+
+static const u64 hp_wmi_pow10[] = {
+	1ULL,
+	10ULL,
+	100ULL,
+	1000ULL,
+	10000ULL,
+	100000ULL,
+	1000000ULL,
+	10000000ULL,
+	100000000ULL,
+	1000000000ULL,
+	10000000000ULL,
+	100000000000ULL,
+	1000000000000ULL,
+	10000000000000ULL,
+	100000000000000ULL,
+	1000000000000000ULL,
+	10000000000000000ULL,
+	100000000000000000ULL,
+	1000000000000000000ULL,
+	10000000000000000000ULL,
+};
+
+/* Dividing any u32 reading by 10^10 or more always rounds to zero. */
+#define HP_WMI_MAX_DIV_EXPONENT		10
+
+/*
+ * make_numeric_scale - make a plan for scaling a numeric sensor reading
+ * @nsensor: pointer to numeric sensor struct
+ *
+ * Stepwise division by 10 with rounding to closest is the same as a single
+ * division by 10^n after adding 5 * (10^n - 1) / 9, i.e. 5, 55, 555, etc.
+ * Stepwise multiplication by 10 with saturation saturates exactly when the
+ * reading exceeds LONG_MAX / 10^n.
+ */
+static void make_numeric_scale(struct hp_wmi_numeric_sensor *nsensor)
+{
+	struct hp_wmi_scale *scale = &nsensor->scale;
+	s64 unit_modifier = nsensor->unit_modifier;
+	s64 target_modifier;
+	u64 exponent;
+
+	/* Fan readings are in RPM units; others are in milliunits. */
+	target_modifier = nsensor->sensor_type == HP_WMI_TYPE_AIR_FLOW ? 0 : -3;
+
+	scale->unit_modifier = nsensor->unit_modifier;
+	scale->divide = unit_modifier < target_modifier;
+
+	if (scale->divide) {
+		exponent = min_t(u64, target_modifier - unit_modifier,
+				 HP_WMI_MAX_DIV_EXPONENT);
+		scale->factor = hp_wmi_pow10[exponent];
+		scale->bias = (scale->factor - 1) / 9 * 5;
+		scale->limit = 0;
+		return;
+	}
+
+	exponent = unit_modifier - target_modifier;
+	scale->bias = 0;
+
+	if (exponent < ARRAY_SIZE(hp_wmi_pow10) &&
+	    hp_wmi_pow10[exponent] <= LONG_MAX) {
+		scale->factor = hp_wmi_pow10[exponent];
+		scale->limit = LONG_MAX / (long)scale->factor;
+	} else {
+		/* Any nonzero reading saturates. */
+		scale->factor = 1;
+		scale->limit = 0;
+	}
+}
+
+/* scale_numeric_sensor - scale sensor reading for hwmon */
+static long scale_numeric_sensor(const struct hp_wmi_numeric_sensor *nsensor)
+{
+	const struct hp_wmi_scale *scale = &nsensor->scale;
+	u32 sensor_type = nsensor->sensor_type;
+	u32 base_units = nsensor->base_units;
+	long val;
+
+	val = nsensor->current_reading;
+
+	if (scale->divide) {
+		if (val >= 0)
+			val = div64_u64(val + scale->bias, scale->factor);
+		else
+			val = -div64_u64(-val + scale->bias, scale->factor);
+	} else if (val > scale->limit) {
+		val = LONG_MAX;
+	} else {
+		val *= (long)scale->factor;
+	}
+
+	if (sensor_type == HP_WMI_TYPE_TEMPERATURE) {
+		switch (base_units) {
+		case HP_WMI_UNITS_DEGREES_F:
+			val -= MILLI * 32;
+			val = val <= LONG_MAX / 5 ?
+				      DIV_ROUND_CLOSEST(val * 5, 9) :
+				      DIV_ROUND_CLOSEST(val, 9) * 5;
+			break;
+
+		case HP_WMI_UNITS_DEGREES_K:
+			val = milli_kelvin_to_millicelsius(val);
+			break;
+		}
+	}
+
+	return val;
+}
+
+/*
+ * classify_numeric_sensor - classify a numeric sensor
+ * @nsensor: pointer to numeric sensor struct
+ *
+ * Returns an enum hp_wmi_type value on success,
+ * or a negative value if the sensor type is unsupported.
+ */
+static int classify_numeric_sensor(const struct hp_wmi_numeric_sensor *nsensor)
+{
+	u32 sensor_type = nsensor->sensor_type;
+	u32 base_units = nsensor->base_units;
+	const char *name = nsensor->name;
+
+	switch (sensor_type) {
+	case HP_WMI_TYPE_TEMPERATURE:
+		/*
+		 * Some systems have sensors named "X Thermal Index" in "Other"
+		 * units. Tested CPU sensor examples were found to be in °C,
+		 * albeit perhaps "differently" accurate; e.g. readings were
+		 * reliably -6°C vs. coretemp on a HP Compaq Elite 8300, and
+		 * +8°C on an EliteOne G1 800. But this is still within the
+		 * realm of plausibility for cheaply implemented motherboard
+		 * sensors, and chassis readings were about as expected.
+		 */
+		if ((base_units == HP_WMI_UNITS_OTHER &&
+		     strstr(name, HP_WMI_PATTERN_TEMP_SENSOR)) ||
+		    base_units == HP_WMI_UNITS_DEGREES_C ||
+		    base_units == HP_WMI_UNITS_DEGREES_F ||
+		    base_units == HP_WMI_UNITS_DEGREES_K)
+			return HP_WMI_TYPE_TEMPERATURE;
+		break;
+
+	case HP_WMI_TYPE_VOLTAGE:
+		if (base_units == HP_WMI_UNITS_VOLTS)
+			return HP_WMI_TYPE_VOLTAGE;
+		break;
+
+	case HP_WMI_TYPE_CURRENT:
+		if (base_units == HP_WMI_UNITS_AMPS)
+			return HP_WMI_TYPE_CURRENT;
+		break;
+
+	case HP_WMI_TYPE_AIR_FLOW:
+		/*
+		 * Strangely, HP considers fan RPM sensor type to be
+		 * "Air Flow" instead of the more intuitive "Tachometer".
+		 */
+		if (base_units == HP_WMI_UNITS_RPM)
+			return HP_WMI_TYPE_AIR_FLOW;
+		break;
+	}
+
+	return -EINVAL;
+}
+
+static u32 hp_wmi_state_hash(const char *string)
+{
+	return jhash(string, strlen(string), 0);
+}
+
+/*
+ * hp_wmi_name_hash - hash the Name of a HPBIOS_BIOSNumericSensor instance
+ * @wobj: pointer to a validated WMI object instance
+ *
+ * Together with the count of instances, the hashes of all sensor Names
+ * fingerprint the firmware's sensor topology.
+ */
+static u32 hp_wmi_name_hash(const union acpi_object *wobj)
+{
+	char name[HP_WMI_MAX_STR_SIZE];
+
+	extract_acpi_string(&wobj->package.elements[HP_WMI_PROPERTY_NAME],
+			    name);
+
+	return hp_wmi_state_hash(name);
+}
+
+/*
+ * find_possible_state - look up a CurrentState value in PossibleStates[]
+ * @nsensor: pointer to numeric sensor struct
+ * @string: CurrentState value
+ *
+ * Returns the index of @string in PossibleStates[] on success,
+ * or a negative error code if @string is not a possible state.
+ */
+static int find_possible_state(const struct hp_wmi_numeric_sensor *nsensor,
+			       const char *string)
+{
+	u32 hash = hp_wmi_state_hash(string);
+	u8 i;
+
+	for (i = 0; i < nsensor->size; i++)
+		if (nsensor->possible_state_hashes[i] == hash &&
+		    !strcmp(nsensor->possible_states[i], string))
+			return i;
+
+	return -ENOENT;
+}
+
+static int
+populate_numeric_sensor_from_wobj(struct device *dev,
+				  struct hp_wmi_numeric_sensor *nsensor,
+				  struct hp_wmi_numeric_layout *layout,
+				  union acpi_object *wobj)
+{
+	int last_prop = HP_WMI_PROPERTY_RATE_UNITS;
+	int prop = HP_WMI_PROPERTY_NAME;
+	const char **possible_states;
+	const char *current_state;
+	union acpi_object *element;
+	acpi_object_type type;
+	char *string;
+	bool is_new;
+	u32 value;
+	u8 size;
+	int err;
+	u8 i;
+
+	err = check_numeric_sensor_wobj(wobj, &size, &is_new);
+	if (err)
+		return err;
+
+	make_numeric_layout(layout, wobj, size, is_new);
+
+	/* Leave room for a CurrentState not in PossibleStates[]. */
+	possible_states = hp_wmi_kcalloc(dev, size + 1,
+					 sizeof(*possible_states));
+	if (!possible_states)
+		return -ENOMEM;
+
+	nsensor->possible_states = possible_states;
+	nsensor->size = size;
+
+	nsensor->possible_state_hashes =
+		hp_wmi_kcalloc(dev, size,
+			       sizeof(*nsensor->possible_state_hashes));
+	if (!nsensor->possible_state_hashes)
+		return -ENOMEM;
+
+	element = wobj->package.elements;
+
+	if (!is_new)
+		last_prop = HP_WMI_PROPERTY_CURRENT_READING;
+
+	for (; prop <= last_prop; prop++) {
+		type = hp_wmi_property_map[prop];
+
+		err = extract_acpi_value(dev, element, type, &value, &string);
+		if (err)
+			return err;
+
+		element++;
+
+		switch (prop) {
+		case HP_WMI_PROPERTY_NAME:
+			nsensor->name = string;
+			break;
+
+		case HP_WMI_PROPERTY_DESCRIPTION:
+			nsensor->description = string;
+			break;
+
+		case HP_WMI_PROPERTY_SENSOR_TYPE:
+			if (value > HP_WMI_TYPE_AIR_FLOW)
+				return -EINVAL;
+
+			nsensor->sensor_type = value;
+			break;
+
+		case HP_WMI_PROPERTY_OTHER_SENSOR_TYPE:
+			nsensor->other_sensor_type = string;
+			break;
+
+		case HP_WMI_PROPERTY_OPERATIONAL_STATUS:
+			nsensor->operational_status = value;
+
+			/* Old variant: CurrentState follows OperationalStatus. */
+			if (!is_new)
+				prop = HP_WMI_PROPERTY_CURRENT_STATE - 1;
+			break;
+
+		case HP_WMI_PROPERTY_SIZE:
+			break;			/* Already set. */
+
+		case HP_WMI_PROPERTY_POSSIBLE_STATES:
+			*possible_states++ = string;
+			if (--size)
+				prop--;
+
+			/* Old variant: BaseUnits follows PossibleStates[]. */
+			if (!is_new && !size)
+				prop = HP_WMI_PROPERTY_BASE_UNITS - 1;
+			break;
+
+		case HP_WMI_PROPERTY_CURRENT_STATE:
+			/* Owned by @nsensor from here on, even on error. */
+			nsensor->possible_states[nsensor->size] = string;
+
+			/* Old variant: PossibleStates[] follows CurrentState. */
+			if (!is_new)
+				prop = HP_WMI_PROPERTY_POSSIBLE_STATES - 1;
+			break;
+
+		case HP_WMI_PROPERTY_BASE_UNITS:
+			nsensor->base_units = value;
+			break;
+
+		case HP_WMI_PROPERTY_UNIT_MODIFIER:
+			/* UnitModifier is signed. */
+			nsensor->unit_modifier = (s32)value;
+			break;
+
+		case HP_WMI_PROPERTY_CURRENT_READING:
+			nsensor->current_reading = value;
+			break;
+
+		case HP_WMI_PROPERTY_RATE_UNITS:
+			nsensor->rate_units = value;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+	}
+
+	size = nsensor->size;
+
+	for (i = 0; i < size; i++)
+		nsensor->possible_state_hashes[i] =
+			hp_wmi_state_hash(nsensor->possible_states[i]);
+
+	make_numeric_scale(nsensor);
+
+	/* CurrentState stays in the spare slot only if it is unlisted. */
+	current_state = nsensor->possible_states[size];
+
+	err = find_possible_state(nsensor, current_state);
+	if (err < 0) {
+		nsensor->current_state = size;
+	} else {
+		nsensor->current_state = err;
+		nsensor->possible_states[size] = NULL;
+		hp_wmi_strfree(dev, current_state);
+	}
+
+	return 0;
+}
+
+/*
+ * put_numeric_sensor_cold - free numeric sensor properties unused by hwmon
+ * @dev: pointer to device
+ * @nsensor: pointer to numeric sensor struct
+ */
+static void put_numeric_sensor_cold(struct device *dev,
+				    struct hp_wmi_numeric_sensor *nsensor)
+{
+	hp_wmi_strfree(dev, nsensor->description);
+	hp_wmi_strfree(dev, nsensor->other_sensor_type);
+
+	nsensor->description = NULL;
+	nsensor->other_sensor_type = NULL;
+}
+
+/*
+ * put_numeric_sensor - free all allocated numeric sensor properties
+ * @dev: pointer to device, or NULL if unmanaged; see hp_wmi_kcalloc()
+ * @nsensor: pointer to numeric sensor struct, which may be partly populated
+ */
+static void put_numeric_sensor(struct device *dev,
+			       struct hp_wmi_numeric_sensor *nsensor)
+{
+	u8 i;
+
+	put_numeric_sensor_cold(dev, nsensor);
+
+	hp_wmi_strfree(dev, nsensor->name);
+	nsensor->name = NULL;
+
+	if (nsensor->possible_states) {
+		/* Includes the slot for an unlisted CurrentState. */
+		for (i = 0; i <= nsensor->size; i++)
+			hp_wmi_strfree(dev, nsensor->possible_states[i]);
+
+		hp_wmi_kfree(dev, nsensor->possible_states);
+		nsensor->possible_states = NULL;
+	}
+
+	hp_wmi_kfree(dev, nsensor->possible_state_hashes);
+	nsensor->possible_state_hashes = NULL;
+}
+
+/*
+ * set_unlisted_state - keep a CurrentState that is not in PossibleStates[]
+ * @dev: pointer to device
+ * @nsensor: pointer to numeric sensor struct
+ * @string: CurrentState value
+ *
+ * As at probe, such a state goes in the slot after PossibleStates[]. The
+ * copy there is only replaced when the state changes, so a sensor that
+ * stays in an unlisted state is not reallocated on every refresh.
+ *
+ * Returns the index of the slot on success, or a negative error code on
+ * error, in which case the slot is left as it was.
+ */
+static int set_unlisted_state(struct device *dev,
+			      struct hp_wmi_numeric_sensor *nsensor,
+			      const char *string)
+{
+	const char **slot = &nsensor->possible_states[nsensor->size];
+	char *copy;
+
+	if (!*slot || strcmp(*slot, string)) {
+		copy = hp_wmi_strdup(dev, string);
+		if (!copy)
+			return -ENOMEM;
+
+		hp_wmi_strfree(dev, *slot);
+		*slot = copy;
+	}
+
+	return nsensor->size;
+}
+
+/*
+ * update_numeric_sensor_from_wobj - update fungible sensor properties
+ * @dev: pointer to device
+ * @nsensor: pointer to numeric sensor struct to update
+ * @layout: pointer to element layout, updated if the package shape changed
+ * @wobj: pointer to WMI object instance
+ *
+ * Returns 0 on success, or a negative error code if @wobj is invalid, in
+ * which case @nsensor is left as it was.
+ */
+static int
+update_numeric_sensor_from_wobj(struct device *dev,
+				struct hp_wmi_numeric_sensor *nsensor,
+				struct hp_wmi_numeric_layout *layout,
+				const union acpi_object *wobj)
+{
+	char string[HP_WMI_MAX_STR_SIZE];
+	const union acpi_object *elements;
+	const union acpi_object *element;
+	bool is_new;
+	int index;
+	u8 size;
+	int err;
+
+	/* Fully revalidate only if the package shape has changed. */
+	if (!numeric_layout_matches(layout, wobj)) {
+		err = check_numeric_sensor_wobj(wobj, &size, &is_new);
+		if (err)
+			return err;
+
+		make_numeric_layout(layout, wobj, size, is_new);
+	}
+
+	elements = wobj->package.elements;
+
+	element = &elements[HP_WMI_PROPERTY_OPERATIONAL_STATUS];
+	nsensor->operational_status = element->integer.value;
+
+	element = &elements[layout->current_state];
+	extract_acpi_string(element, string);
+
+	index = find_possible_state(nsensor, string);
+	if (index < 0)
+		index = set_unlisted_state(dev, nsensor, string);
+
+	/* Keep the previous CurrentState only if out of memory. */
+	if (index >= 0)
+		WRITE_ONCE(nsensor->current_state, index);
+
+	element = &elements[layout->unit_modifier];
+	nsensor->unit_modifier = (s32)element->integer.value;
+
+	if (nsensor->unit_modifier != nsensor->scale.unit_modifier)
+		make_numeric_scale(nsensor);
+
+	element = &elements[layout->current_reading];
+	nsensor->current_reading = element->integer.value;
+
+	return 0;
+}
+
+/*
+ * check_platform_events_wobj - validate a HPBIOS_PlatformEvents instance
+ * @wobj: pointer to WMI object instance to check
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int check_platform_events_wobj(const union acpi_object *wobj)
+{
+	return check_wobj(wobj, hp_wmi_platform_events_property_map,
+			  HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS);
+}
+
+static int
+populate_platform_events_from_wobj(struct device *dev,
+				   struct hp_wmi_platform_events *pevents,
+				   union acpi_object *wobj)
+{
+	int last_prop = HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS;
+	int prop = HP_WMI_PLATFORM_EVENTS_PROPERTY_NAME;
+	union acpi_object *element;
+	acpi_object_type type;
+	char *string;
+	u32 value;
+	int err;
+
+	err = check_platform_events_wobj(wobj);
+	if (err)
+		return err;
+
+	element = wobj->package.elements;
+
+	for (; prop <= last_prop; prop++, element++) {
+		type = hp_wmi_platform_events_property_map[prop];
+
+		err = extract_acpi_value(dev, element, type, &value, &string);
+		if (err)
+			return err;
+
+		switch (prop) {
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_NAME:
+			pevents->name = string;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_DESCRIPTION:
+			pevents->description = string;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_SOURCE_NAMESPACE:
+			pevents->source_namespace = string;
+
+			if (strcasecmp(HP_WMI_EVENT_NAMESPACE, string))
+				return -EINVAL;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_SOURCE_CLASS:
+			pevents->source_class = string;
+
+			if (strcasecmp(HP_WMI_EVENT_CLASS, string))
+				return -EINVAL;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_CATEGORY:
+			pevents->category = value;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_SEVERITY:
+			pevents->possible_severity = value;
+			break;
+
+		case HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS:
+			pevents->possible_status = value;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * put_platform_events - free platform events objects from
+ *                       init_platform_events()
+ * @dev: pointer to device, or NULL if unmanaged; see hp_wmi_kcalloc()
+ * @pevents: array of platform events objects
+ * @count: count of platform events objects
+ */
+static void put_platform_events(struct device *dev,
+				struct hp_wmi_platform_events *pevents,
+				u16 count)
+{
+	u16 i;
+
+	if (!pevents)
+		return;
+
+	for (i = 0; i < count; i++) {
+		hp_wmi_strfree(dev, pevents[i].name);
+		hp_wmi_strfree(dev, pevents[i].description);
+		hp_wmi_strfree(dev, pevents[i].source_namespace);
+		hp_wmi_strfree(dev, pevents[i].source_class);
+	}
+
+	hp_wmi_kfree(dev, pevents);
+}
+
+static int init_platform_events(struct device *dev,
+				struct hp_wmi_platform_events **out_pevents,
+				u16 *out_pcount)
+{
+	struct hp_wmi_platform_events *pevents_arr;
+	struct hp_wmi_platform_events *pevents;
+	struct acpi_buffer *wobjs;
+	int count;
+	int err;
+	u16 i;
+
+	count = hp_wmi_get_wobjs(HP_WMI_PLATFORM_EVENTS_GUID, &wobjs);
+	if (count < 0) {
+		err = count;
+		goto out_put_wobjs;
+	}
+
+	if (!count) {
+		*out_pcount = 0;
+
+		err = 0;
+		goto out_put_wobjs;
+	}
+
+	pevents_arr = hp_wmi_kcalloc(dev, count, sizeof(*pevents));
+	if (!pevents_arr) {
+		err = -ENOMEM;
+		goto out_put_wobjs;
+	}
+
+	for (i = 0, pevents = pevents_arr; i < count; i++, pevents++) {
+		err = populate_platform_events_from_wobj(dev, pevents,
+							 wobjs[i].pointer);
+		if (err) {
+			put_platform_events(dev, pevents_arr, i + 1);
+			goto out_put_wobjs;
+		}
+	}
+
+	*out_pevents = pevents_arr;
+	*out_pcount = count;
+
+out_put_wobjs:
+	hp_wmi_put_wobjs(wobjs);
+
+	return err;
+}
+
+/*
+ * check_event_wobj - validate a HPBIOS_BIOSEvent instance
+ * @wobj: pointer to WMI object instance to check
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int check_event_wobj(const union acpi_object *wobj)
+{
+	return check_wobj(wobj, hp_wmi_event_property_map,
+			  HP_WMI_EVENT_PROPERTY_STATUS);
+}
+
+static int populate_event_from_wobj(struct hp_wmi_event *event,
+				    const union acpi_object *wobj)
+{
+	const union acpi_object *elements;
+	const union acpi_object *element;
+	int err;
+
+	err = check_event_wobj(wobj);
+	if (err)
+		return err;
+
+	elements = wobj->package.elements;
+
+	extract_acpi_string(&elements[HP_WMI_EVENT_PROPERTY_NAME], event->name);
+	extract_acpi_string(&elements[HP_WMI_EVENT_PROPERTY_DESCRIPTION],
+			    event->description);
+
+	element = &elements[HP_WMI_EVENT_PROPERTY_CATEGORY];
+	event->category = element->integer.value;
+
+	return 0;
+}
+
+/*
+ * classify_event - classify an event
+ * @name: event name
+ * @category: event category
+ *
+ * Classify instances of both HPBIOS_PlatformEvents and HPBIOS_BIOSEvent from
+ * property values. Recognition criteria are based on multiple ACPI dumps [3].
+ *
+ * Returns an enum hp_wmi_type value on success,
+ * or a negative value if the event type is unsupported.
+ */
+static int classify_event(const char *event_name, u32 category)
+{
+	if (category != HP_WMI_CATEGORY_SENSOR)
+		return -EINVAL;
+
+	/* Fan events have Name "X Stall". */
+	if (strstr(event_name, HP_WMI_PATTERN_FAN_ALARM))
+		return HP_WMI_TYPE_AIR_FLOW;
+
+	/* Intrusion events have Name "Hood Intrusion". */
+	if (!strcmp(event_name, HP_WMI_PATTERN_INTRUSION_ALARM))
+		return HP_WMI_TYPE_INTRUSION;
+
+	/*
+	 * Temperature events have Name either "Thermal Caution" or
+	 * "Thermal Critical". Deal only with "Thermal Critical" events.
+	 *
+	 * "Thermal Caution" events have Status "Stressed", informing us that
+	 * the OperationalStatus of the related sensor has become "Stressed".
+	 * However, this is already a fault condition that will clear itself
+	 * when the sensor recovers, so we have no further interest in them.
+	 */
+	if (!strcmp(event_name, HP_WMI_PATTERN_TEMP_ALARM))
+		return HP_WMI_TYPE_TEMPERATURE;
+
+	return -EINVAL;
+}
+
+/* hp_wmi_event_hash - hash event Name and Description for dispatch */
+static u32 hp_wmi_event_hash(const char *name, const char *description)
+{
+	return jhash(description, strlen(description),
+		     jhash(name, strlen(name), 0));
+}
+
+/*
+ * update_reading_history - fold a good reading into lowest, highest, average
+ * @reading: pointer to cached sensor reading
+ *
+ * The average keeps HP_WMI_EWMA_FRAC_BITS below its unit. Otherwise, each
+ * update would drop up to HP_WMI_EWMA_WEIGHT - 1 units of the difference,
+ * and the average could settle that far from a steady reading.
+ */
+static void update_reading_history(struct hp_wmi_reading *reading)
+{
+	long val = reading->cached_val;
+	long fixed;
+
+	fixed = clamp_val(val, -HP_WMI_EWMA_LIMIT, HP_WMI_EWMA_LIMIT) *
+		HP_WMI_EWMA_ONE;
+
+	if (!reading->has_history) {
+		reading->lowest = val;
+		reading->highest = val;
+		reading->average = fixed;
+		reading->has_history = true;
+		return;
+	}
+
+	reading->lowest = min(reading->lowest, val);
+	reading->highest = max(reading->highest, val);
+	reading->average += (fixed - reading->average) / HP_WMI_EWMA_WEIGHT;
+}
+
+/*
+ * interpret_info - interpret sensor for hwmon
+ * @info: pointer to sensor info struct
+ *
+ * Should be called after the numeric sensor member has been updated.
+ */
+static void interpret_info(struct hp_wmi_info *info)
+{
+	const struct hp_wmi_numeric_sensor *nsensor = &info->nsensor;
+
+	struct hp_wmi_reading *reading = info->reading;
+
+	reading->cached_val = scale_numeric_sensor(nsensor);
+	/* A reading from some other sensor is no better than none at all. */
+	reading->fault = info->mismatch || numeric_sensor_has_fault(nsensor);
+	reading->last_updated = jiffies;
+
+	/* A faulty sensor's reading is meaningless, so leave it out. */
+	if (!reading->fault)
+		update_reading_history(reading);
+}
+
+/*
+ * reset_reading_history - restart lowest, highest and average values
+ * @reading: pointer to cached sensor reading
+ *
+ * The current value becomes the new starting point for all of them, unless
+ * the sensor has the fault condition. Then, the first good reading does.
+ */
+static void reset_reading_history(struct hp_wmi_reading *reading)
+{
+	reading->has_history = false;
+
+	if (!reading->fault)
+		update_reading_history(reading);
+}
+
+/* hp_wmi_lifetime - get sensor cache lifetime in jiffies by hwmon type */
+static unsigned long hp_wmi_lifetime(const struct hp_wmi_sensors *state,
+				     enum hwmon_sensor_types type)
+{
+	unsigned int interval = READ_ONCE(update_intervals[type]);
+
+	if (!interval)
+		interval = READ_ONCE(state->update_interval);
+
+	return msecs_to_jiffies(interval);
+}
+
+/*
+ * hp_wmi_reading_lifetime - get cache lifetime in jiffies of a reading
+ * @state: pointer to driver state
+ * @reading: pointer to cached sensor reading
+ *
+ * In adaptive mode, the lifetime of a stable reading is doubled for each
+ * refresh that found it unchanged, up to adaptive_max_interval.
+ */
+static unsigned long
+hp_wmi_reading_lifetime(const struct hp_wmi_sensors *state,
+			const struct hp_wmi_reading *reading)
+{
+	unsigned long lifetime = hp_wmi_lifetime(state, reading->type);
+	unsigned int max_interval = READ_ONCE(adaptive_max_interval);
+	u8 backoff = READ_ONCE(reading->backoff);
+	unsigned long max_lifetime;
+
+	if (!max_interval || !backoff)
+		return lifetime;
+
+	max_lifetime = msecs_to_jiffies(max_interval);
+	if (lifetime >= max_lifetime)
+		return lifetime;
+
+	if (lifetime > max_lifetime >> backoff)
+		return max_lifetime;
+
+	return lifetime << backoff;
+}
+
+/*
+ * hp_wmi_reading_expires - check whether a reading is stale within a margin
+ * @state: pointer to driver state
+ * @reading: pointer to cached sensor reading
+ * @margin: time in jiffies from now
+ *
+ * The background poller passes its interval as @margin, so that a reading
+ * due to go stale before the next poll is refreshed by this one.
+ */
+static bool hp_wmi_reading_expires(const struct hp_wmi_sensors *state,
+				   const struct hp_wmi_reading *reading,
+				   unsigned long margin)
+{
+	unsigned long lifetime = hp_wmi_reading_lifetime(state, reading);
+
+	/* Beyond the lifetime, a margin changes nothing but may overflow. */
+	margin = min(margin, lifetime);
+
+	return time_after(jiffies, reading->last_updated + lifetime - margin);
+}
+
+static bool hp_wmi_reading_is_stale(const struct hp_wmi_sensors *state,
+				    const struct hp_wmi_reading *reading)
+{
+	return hp_wmi_reading_expires(state, reading, 0);
+}
+
+/*
+ * hp_wmi_adapt - adapt the cache lifetime of a reading after a refresh
+ * @reading: pointer to cached sensor reading, newly refreshed
+ * @prev_val: previous value of the reading
+ * @status_changed: whether OperationalStatus changed
+ *
+ * A reading that stayed within the deadband backs off; any other change
+ * snaps it back to the unstretched lifetime.
+ *
+ * Caller must hold the lock of the sensor's group.
+ */
+static void hp_wmi_adapt(struct hp_wmi_reading *reading, long prev_val,
+			 bool status_changed)
+{
+	unsigned int deadband = min(READ_ONCE(adaptive_deadband), 100U);
+	unsigned long delta = abs(reading->cached_val - prev_val);
+	unsigned long band = mult_frac((unsigned long)abs(prev_val), deadband,
+				       100);
+
+	if (!READ_ONCE(adaptive_max_interval))
+		return;
+
+	if (status_changed || delta > band)
+		WRITE_ONCE(reading->backoff, 0);
+	else if (reading->backoff < HP_WMI_MAX_BACKOFF)
+		WRITE_ONCE(reading->backoff, reading->backoff + 1);
+}
+
+static struct hp_wmi_info *
+hp_wmi_reading_info(const struct hp_wmi_sensors *state,
+		    const struct hp_wmi_reading *reading)
+{
+	return &state->info[reading->instance];
+}
+
+static u8 hp_wmi_reading_channel(const struct hp_wmi_sensors *state,
+				 const struct hp_wmi_reading *reading)
+{
+	return reading - state->reading_map[reading->type];
+}
+
+static struct hp_wmi_limits *
+hp_wmi_reading_limits(const struct hp_wmi_sensors *state,
+		      const struct hp_wmi_reading *reading)
+{
+	return &state->limits[reading - state->readings];
+}
+
+/*
+ * hp_wmi_record - add the current reading of a sensor to its history
+ * @state: pointer to driver state
+ * @info: pointer to sensor info struct
+ *
+ * Caller must hold the lock of the sensor's group.
+ */
+static void hp_wmi_record(const struct hp_wmi_sensors *state,
+			  struct hp_wmi_info *info)
+{
+	struct hp_wmi_history *history = &info->history;
+	const struct hp_wmi_reading *reading = info->reading;
+	struct hp_wmi_sample *sample;
+
+	if (!history->samples)
+		return;
+
+	sample = &history->samples[history->next];
+
+	sample->timestamp_ns = ktime_get_ns();
+	sample->value = reading->cached_val;
+	sample->operational_status = info->nsensor.operational_status;
+	sample->type = reading->type;
+	sample->channel = hp_wmi_reading_channel(state, reading);
+
+	if (++history->next == state->history_len)
+		history->next = 0;
+	if (history->count < state->history_len)
+		history->count++;
+}
+
+/*
+ * hp_wmi_queue_notify - queue a notification of a hwmon attribute change
+ * @state: pointer to driver state
+ * @kind: kind of notification
+ * @type: hwmon sensor type
+ * @channel: hwmon channel number
+ *
+ * Notifications are sent from a work item, because hwmon_notify_event() may
+ * call into the thermal core, which may itself be reading a sensor and hold
+ * locks that would then be taken again.
+ */
+static void hp_wmi_queue_notify(struct hp_wmi_sensors *state,
+				enum hp_wmi_notify_kind kind,
+				enum hwmon_sensor_types type, u8 channel)
+{
+	set_bit(channel, state->pending[kind][type]);
+	schedule_work(&state->notify_work);
+}
+
+static void hp_wmi_notify_work(struct work_struct *work)
+{
+	struct hp_wmi_sensors *state;
+	enum hp_wmi_notify_kind kind;
+	enum hwmon_sensor_types type;
+	unsigned long *pending;
+	unsigned long channel;
+	struct device *hwdev;
+	u32 attr;
+
+	state = container_of(work, struct hp_wmi_sensors, notify_work);
+
+	hwdev = READ_ONCE(state->hwdev);
+	if (!hwdev)
+		return;
+
+	for (kind = 0; kind < HP_WMI_NOTIFY_MAX; kind++) {
+		for (type = hwmon_chip; type < hwmon_max; type++) {
+			pending = state->pending[kind][type];
+			attr = hp_wmi_notify_attrs[kind][type];
+
+			for_each_set_bit(channel, pending, HP_WMI_MAX_INSTANCES)
+				if (test_and_clear_bit(channel, pending))
+					hwmon_notify_event(hwdev, type, attr,
+							   channel);
+		}
+	}
+}
+
+/* hp_wmi_account_hit - count a read that was served from the cache */
+static void hp_wmi_account_hit(struct hp_wmi_info *info)
+{
+	atomic_inc(&info->stats.hits);
+
+	trace_hp_wmi_sensors_cache_hit(info->instance, info->type);
+}
+
+/*
+ * hp_wmi_account_query - add a WMI query to sensor statistics
+ * @stats: pointer to sensor statistics
+ * @elapsed: duration of the query
+ * @failed: whether the query failed
+ *
+ * Caller must hold the lock of the sensor's group.
+ */
+static void hp_wmi_account_query(struct hp_wmi_stats *stats, ktime_t elapsed,
+				 bool failed)
+{
+	u64 ns = ktime_to_ns(elapsed);
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	u8 bucket = 0;
+
+	if (us)
+		bucket = min_t(u64, ilog2(us) + 1, HP_WMI_STATS_BUCKETS - 1);
+
+	if (!stats->queries || ns < stats->min_ns)
+		stats->min_ns = ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+
+	stats->queries++;
+	stats->errors += failed;
+	stats->total_ns += ns;
+	stats->histogram[bucket]++;
+}
+
+/*
+ * hp_wmi_check_limits - check a refreshed reading against its thresholds
+ * @state: pointer to driver state
+ * @reading: pointer to cached sensor reading
+ *
+ * While a threshold is crossed, each refresh raises its alarm flag again.
+ * Userspace is notified only when the threshold is first crossed.
+ *
+ * Caller must hold the lock of the sensor's group.
+ */
+static void hp_wmi_check_limits(struct hp_wmi_sensors *state,
+				struct hp_wmi_reading *reading)
+{
+	enum hwmon_sensor_types type = reading->type;
+	const struct hp_wmi_limits *limits;
+	unsigned long prev = reading->over_limits;
+	long val = reading->cached_val;
+	unsigned long crossed = 0;
+	unsigned long kind;
+	u8 channel;
+
+	switch (type) {
+	case hwmon_temp:
+		limits = hp_wmi_reading_limits(state, reading);
+
+		/* A faulty temperature reading is meaningless. */
+		if (reading->fault)
+			break;
+
+		if (limits->max && val >= limits->max)
+			__set_bit(HP_WMI_LIMIT_TEMP_MAX, &crossed);
+		if (limits->crit && val >= limits->crit)
+			__set_bit(HP_WMI_LIMIT_TEMP_CRIT, &crossed);
+		break;
+
+	case hwmon_fan:
+		limits = hp_wmi_reading_limits(state, reading);
+
+		/* But a fan fault usually means it has stalled. */
+		if (limits->min && val < limits->min)
+			__set_bit(HP_WMI_LIMIT_FAN_MIN, &crossed);
+		break;
+
+	default:
+		return;
+	}
+
+	channel = hp_wmi_reading_channel(state, reading);
+
+	for_each_set_bit(kind, &crossed, HP_WMI_LIMIT_KINDS) {
+		set_bit(channel, state->limit_alarms[kind]);
+		if (!test_bit(kind, &prev))
+			hp_wmi_queue_notify(state, hp_wmi_limit_notify[kind],
+					    type, channel);
+	}
+
+	reading->over_limits = crossed;
+}
+
+/* hp_wmi_topology_changed - warn once that sensors have changed since probe */
+static void hp_wmi_topology_changed(struct hp_wmi_sensors *state)
+{
+	if (test_and_set_bit(0, &state->topology_changed))
+		return;
+
+	dev_warn(state->dev,
+		 "Sensors changed since probe; rebind driver to rediscover\n");
+}
+
+/*
+ * hp_wmi_refresh_info - poll WMI to refresh sensor info
+ * @state: pointer to driver state
+ * @info: pointer to sensor info struct
+ *
+ * Caller must hold the lock of the sensor's group.
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int hp_wmi_refresh_info(struct hp_wmi_sensors *state,
+			       struct hp_wmi_info *info)
+{
+	struct hp_wmi_group *group = &state->groups[info->type];
+	struct hp_wmi_numeric_sensor *nsensor = &info->nsensor;
+	struct hp_wmi_reading *reading = info->reading;
+	u32 status = nsensor->operational_status;
+	long prev_val = reading->cached_val;
+	struct device *dev = state->dev;
+	union acpi_object *wobj;
+	u8 instance = info->instance;
+	bool fault = reading->fault;
+	ktime_t elapsed;
+	ktime_t start;
+	int err;
+
+	trace_hp_wmi_sensors_query_start(instance);
+
+	start = ktime_get();
+
+	wobj = hp_wmi_get_wobj_scratch(dev, HP_WMI_NUMERIC_SENSOR_GUID,
+				       instance, &group->scratch);
+
+	elapsed = ktime_sub(ktime_get(), start);
+
+	trace_hp_wmi_sensors_query_end(instance, ktime_to_ns(elapsed),
+				       wobj ? 0 : -EIO);
+
+	hp_wmi_account_query(&info->stats, elapsed, !wobj);
+
+	if (!wobj)
+		return -EIO;
+
+	/* Dump even an invalid instance; that is when a dump helps most. */
+	if (info->raw)
+		info->raw_size = serialize_wobj(wobj, info->raw,
+						HP_WMI_RAW_SIZE);
+
+	/* On error, keep the previous values; readers just see no change. */
+	err = update_numeric_sensor_from_wobj(dev, nsensor, &info->layout,
+					      wobj);
+
+	trace_hp_wmi_sensors_decode(instance, info->layout.is_new, err);
+
+	/* Check lazily, as part of a refresh that polls WMI anyway. */
+	if (!err && info->verify) {
+		info->verify = false;
+
+		if (hp_wmi_name_hash(wobj) != info->name_hash) {
+			info->mismatch = true;
+			hp_wmi_topology_changed(state);
+		}
+	}
+
+	write_seqcount_begin(&group->seq);
+	interpret_info(info);
+	write_seqcount_end(&group->seq);
+
+	hp_wmi_adapt(reading, prev_val, nsensor->operational_status != status);
+	hp_wmi_record(state, info);
+	hp_wmi_check_limits(state, reading);
+
+	if (READ_ONCE(notify_faults) && reading->fault != fault &&
+	    (info->type == hwmon_temp || info->type == hwmon_fan))
+		hp_wmi_queue_notify(state, HP_WMI_NOTIFY_FAULT, info->type,
+				    hp_wmi_reading_channel(state, reading));
+
+	return 0;
+}
+
+/*
+ * hp_wmi_refresh_group - refresh stale info for all hwmon channels of a type
+ * @state: pointer to driver state
+ * @type: hwmon sensor type
+ * @margin: also refresh info that goes stale within this many jiffies
+ *
+ * Userspace tends to read every hwmon channel at once, so refreshing them
+ * all together lets the rest of such a sweep be served from the cache.
+ * Errors are ignored; an affected sensor stays stale and is retried when
+ * it is read by itself. Disconnected sensors are not batched.
+ *
+ * Caller must hold the lock of the group for @type.
+ */
+static void hp_wmi_refresh_group(struct hp_wmi_sensors *state,
+				 enum hwmon_sensor_types type,
+				 unsigned long margin)
+{
+	struct hp_wmi_reading *reading = state->reading_map[type];
+	struct hp_wmi_info *info;
+	u16 i;
+
+	if (type == hwmon_chip)
+		return;
+
+	for (i = 0; i < state->channel_count[type]; i++, reading++) {
+		if (!hp_wmi_reading_expires(state, reading, margin))
+			continue;
+
+		info = hp_wmi_reading_info(state, reading);
+		hp_wmi_refresh_info(state, info);
+	}
+}
+
+/*
+ * hp_wmi_update_info - poll WMI to update sensor info if stale
+ * @state: pointer to driver state
+ * @info: pointer to sensor info struct
+ *
+ * If the sensor info is stale, all other stale sensors of the same hwmon
+ * type are also updated in the same pass. Sensors of other types are not
+ * locked out meanwhile.
+ *
+ * Returns 0 on success, or a negative error code on error.
+ */
+static int hp_wmi_update_info(struct hp_wmi_sensors *state,
+			      struct hp_wmi_info *info)
+{
+	struct hp_wmi_group *group = &state->groups[info->type];
+	int ret = 0;
+
+	if (!hp_wmi_reading_is_stale(state, info->reading)) {
+		hp_wmi_account_hit(info);
+		return 0;
+	}
+
+	mutex_lock(&group->lock);
+
+	/*
+	 * Check again: if others were waiting to refresh the same sensor,
+	 * only the first of them should actually poll WMI.
+	 */
+	if (!hp_wmi_reading_is_stale(state, info->reading)) {
+		hp_wmi_account_hit(info);
+		goto out_unlock;
+	}
+
+	atomic_inc(&info->stats.misses);
+
+	ret = hp_wmi_refresh_info(state, info);
+	if (!ret)
+		hp_wmi_refresh_group(state, info->type, 0);
+
+out_unlock:
+	mutex_unlock(&group->lock);
+
+	return ret;
+}
+
+static bool hp_wmi_is_history(enum hwmon_sensor_types type, u32 attr)
+{
+	switch (type) {
+	case hwmon_temp:
+		return attr == hwmon_temp_lowest || attr == hwmon_temp_highest;
+	case hwmon_in:
+		return attr == hwmon_in_average || attr == hwmon_in_lowest ||
+		       attr == hwmon_in_highest;
+	case hwmon_curr:
+		return attr == hwmon_curr_average ||
+		       attr == hwmon_curr_lowest ||
+		       attr == hwmon_curr_highest;
+	default:
+		return false;
+	}
+}
+
+/* hp_wmi_reading_attr - get the value of a hwmon attribute from a reading */
+static long hp_wmi_reading_attr(const struct hp_wmi_reading *reading,
+				enum hwmon_sensor_types type, u32 attr)
+{
+	switch (type) {
+	case hwmon_temp:
+		if (attr == hwmon_temp_fault)
+			return reading->fault;
+		if (attr == hwmon_temp_lowest)
+			return reading->lowest;
+		if (attr == hwmon_temp_highest)
+			return reading->highest;
+		break;
+
+	case hwmon_in:
+		if (attr == hwmon_in_average)
+			return DIV_ROUND_CLOSEST(reading->average,
+						 HP_WMI_EWMA_ONE);
+		if (attr == hwmon_in_lowest)
+			return reading->lowest;
+		if (attr == hwmon_in_highest)
+			return reading->highest;
+		break;
+
+	case hwmon_curr:
+		if (attr == hwmon_curr_average)
+			return DIV_ROUND_CLOSEST(reading->average,
+						 HP_WMI_EWMA_ONE);
+		if (attr == hwmon_curr_lowest)
+			return reading->lowest;
+		if (attr == hwmon_curr_highest)
+			return reading->highest;
+		break;
+
+	case hwmon_fan:
+		if (attr == hwmon_fan_fault)
+			return reading->fault;
+		break;
+
+	default:
+		break;
+	}
+
+	return reading->cached_val;
+}
+
+/*
+ * hp_wmi_read_cached - read a hwmon attribute from a reading without locking
+ * @state: pointer to driver state
+ * @reading: pointer to cached sensor reading
+ * @type: hwmon sensor type
+ * @attr: hwmon attribute, which must not be a threshold
+ *
+ * Only the member of @reading that backs @attr is copied, but the copy is
+ * consistent with the rest of the reading as of the same update.
+ *
+ * Returns 0 on success, or -ENODATA for a lowest, highest or average value
+ * while no good reading was seen since the history was last reset.
+ */
+static int hp_wmi_read_cached(struct hp_wmi_sensors *state,
+			      const struct hp_wmi_reading *reading,
+			      enum hwmon_sensor_types type, u32 attr,
+			      long *out_val)
+{
+	struct hp_wmi_group *group = &state->groups[type];
+	bool has_history;
+	unsigned int seq;
+	long val;
 
-			/* Old variant: BaseUnits follows PossibleStates[]. */
-			if (!is_new && !size)
-				prop = HP_WMI_PROPERTY_BASE_UNITS - 1;
-			break;
+	do {
+		seq = read_seqcount_begin(&group->seq);
 
-		case HP_WMI_PROPERTY_CURRENT_STATE:
-			nsensor->current_state = string;
+		val = hp_wmi_reading_attr(reading, type, attr);
+		has_history = reading->has_history;
+	} while (read_seqcount_retry(&group->seq, seq));
 
-			/* Old variant: PossibleStates[] follows CurrentState. */
-			if (!is_new)
-				prop = HP_WMI_PROPERTY_POSSIBLE_STATES - 1;
-			break;
+	if (!has_history && hp_wmi_is_history(type, attr))
+		return -ENODATA;
 
-		case HP_WMI_PROPERTY_BASE_UNITS:
-			nsensor->base_units = value;
-			break;
+	*out_val = val;
 
-		case HP_WMI_PROPERTY_UNIT_MODIFIER:
-			/* UnitModifier is signed. */
-			nsensor->unit_modifier = (s32)value;
-			break;
+	return 0;
+}
 
-		case HP_WMI_PROPERTY_CURRENT_READING:
-			nsensor->current_reading = value;
-			break;
+/* hp_wmi_read_limit - read a threshold of a sensor without locking */
+static long hp_wmi_read_limit(const struct hp_wmi_sensors *state,
+			      const struct hp_wmi_reading *reading,
+			      enum hwmon_sensor_types type, u32 attr)
+{
+	const struct hp_wmi_limits *limits;
 
-		case HP_WMI_PROPERTY_RATE_UNITS:
-			nsensor->rate_units = value;
-			break;
+	limits = hp_wmi_reading_limits(state, reading);
 
-		default:
-			return -EINVAL;
-		}
-	}
+	if (type == hwmon_fan)
+		return READ_ONCE(limits->min);
+	if (attr == hwmon_temp_max)
+		return READ_ONCE(limits->max);
 
-	*out_is_new = is_new;
+	return READ_ONCE(limits->crit);
+}
 
-	return 0;
+static bool hp_wmi_is_limit(enum hwmon_sensor_types type, u32 attr)
+{
+	return (type == hwmon_temp && attr == hwmon_temp_max) ||
+	       (type == hwmon_temp && attr == hwmon_temp_crit) ||
+	       (type == hwmon_fan  && attr == hwmon_fan_min);
 }
 
-/* update_numeric_sensor_from_wobj - update fungible sensor properties */
-static void
-update_numeric_sensor_from_wobj(struct device *dev,
-				struct hp_wmi_numeric_sensor *nsensor,
-				const union acpi_object *wobj)
+/* hp_wmi_limit_alarm - get threshold kind of an alarm attribute, or -1 */
+static int hp_wmi_limit_alarm(enum hwmon_sensor_types type, u32 attr)
 {
-	const union acpi_object *elements;
-	const union acpi_object *element;
-	const char *new_string;
-	char *trimmed;
-	char *string;
-	bool is_new;
-	int offset;
-	u8 size;
-	int err;
+	if (type == hwmon_temp && attr == hwmon_temp_max_alarm)
+		return HP_WMI_LIMIT_TEMP_MAX;
+	if (type == hwmon_temp && attr == hwmon_temp_crit_alarm)
+		return HP_WMI_LIMIT_TEMP_CRIT;
+	if (type == hwmon_fan && attr == hwmon_fan_min_alarm)
+		return HP_WMI_LIMIT_FAN_MIN;
+
+	return -1;
+}
 
-	err = check_numeric_sensor_wobj(wobj, &size, &is_new);
-	if (err)
-		return;
+/* hp_wmi_has_limits - check whether any threshold of a reading is set */
+static bool hp_wmi_has_limits(const struct hp_wmi_sensors *state,
+			      const struct hp_wmi_reading *reading)
+{
+	const struct hp_wmi_limits *limits;
 
-	elements = wobj->package.elements;
+	limits = hp_wmi_reading_limits(state, reading);
 
-	element = &elements[HP_WMI_PROPERTY_OPERATIONAL_STATUS];
-	nsensor->operational_status = element->integer.value;
+	switch (reading->type) {
+	case hwmon_temp:
+		return READ_ONCE(limits->max) || READ_ONCE(limits->crit);
+	case hwmon_fan:
+		return READ_ONCE(limits->min);
+	default:
+		return false;
+	}
+}
 
-	/*
-	 * In general, an index offset is needed after PossibleStates[0].
-	 * On a new variant, CurrentState is after PossibleStates[]. This is
-	 * not the case on an old variant, but we still need to offset the
-	 * read because CurrentState is where Size would be on a new variant.
-	 */
-	offset = is_new ? size - 1 : -2;
+static bool hp_wmi_is_reset_history(enum hwmon_sensor_types type, u32 attr)
+{
+	return (type == hwmon_temp && attr == hwmon_temp_reset_history) ||
+	       (type == hwmon_in   && attr == hwmon_in_reset_history) ||
+	       (type == hwmon_curr && attr == hwmon_curr_reset_history);
+}
 
-	element = &elements[HP_WMI_PROPERTY_CURRENT_STATE + offset];
-	string = element->type == ACPI_TYPE_BUFFER ?
-		convert_raw_wmi_string(element->buffer.pointer) :
-		element->string.pointer;
-
-	if (string) {
-		trimmed = strim(string);
-		if (strcmp(trimmed, nsensor->current_state)) {
-			new_string = hp_wmi_strdup(dev, trimmed);
-			if (new_string) {
-				devm_kfree(dev, nsensor->current_state);
-				nsensor->current_state = new_string;
-			}
-		}
-		if (element->type == ACPI_TYPE_BUFFER)
-			kfree(string);
-	}
+/*
+ * hp_wmi_refresh_all - refresh stale info for all hwmon channels
+ * @state: pointer to driver state
+ * @margin: also refresh info that goes stale within this many jiffies
+ */
+static void hp_wmi_refresh_all(struct hp_wmi_sensors *state,
+			       unsigned long margin)
+{
+	enum hwmon_sensor_types type;
+	struct hp_wmi_group *group;
 
-	/* Old variant: -2 (not -1) because it lacks the Size property. */
-	if (!is_new)
-		offset = (int)size - 2;	/* size is > 0, i.e. may be 1. */
+	for (type = hwmon_chip; type < hwmon_max; type++) {
+		if (!state->reading_map[type])
+			continue;
 
-	element = &elements[HP_WMI_PROPERTY_UNIT_MODIFIER + offset];
-	nsensor->unit_modifier = (s32)element->integer.value;
+		group = &state->groups[type];
 
-	element = &elements[HP_WMI_PROPERTY_CURRENT_READING + offset];
-	nsensor->current_reading = element->integer.value;
+		mutex_lock(&group->lock);
+		hp_wmi_refresh_group(state, type, margin);
+		mutex_unlock(&group->lock);
+	}
 }
 
 /*
- * check_platform_events_wobj - validate a HPBIOS_PlatformEvents instance
- * @wobj: pointer to WMI object instance to check
+ * hp_wmi_limits_interval - get how often to check thresholds in jiffies
+ * @state: pointer to driver state
  *
- * Returns 0 on success, or a negative error code on error.
+ * This is the shortest cache lifetime among sensors with a threshold set,
+ * so that each of them is refreshed about as often as it goes stale.
+ *
+ * Returns the interval, or 0 if no threshold is set.
  */
-static int check_platform_events_wobj(const union acpi_object *wobj)
+static unsigned long
+hp_wmi_limits_interval(const struct hp_wmi_sensors *state)
 {
-	return check_wobj(wobj, hp_wmi_platform_events_property_map,
-			  HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS);
+	const struct hp_wmi_reading *reading = state->readings;
+	unsigned long interval = 0;
+	unsigned long lifetime;
+	u16 i;
+
+	for (i = 0; i < state->count; i++, reading++) {
+		if (!hp_wmi_has_limits(state, reading))
+			continue;
+
+		lifetime = hp_wmi_reading_lifetime(state, reading);
+		if (!interval || lifetime < interval)
+			interval = lifetime;
+	}
+
+	return interval;
 }
 
-static int
-populate_platform_events_from_wobj(struct device *dev,
-				   struct hp_wmi_platform_events *pevents,
-				   union acpi_object *wobj)
+/*
+ * hp_wmi_refresh_limited - refresh stale info for sensors with thresholds
+ * @state: pointer to driver state
+ * @type: hwmon sensor type
+ * @margin: also refresh info that goes stale within this many jiffies
+ */
+static void hp_wmi_refresh_limited(struct hp_wmi_sensors *state,
+				   enum hwmon_sensor_types type,
+				   unsigned long margin)
 {
-	int last_prop = HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS;
-	int prop = HP_WMI_PLATFORM_EVENTS_PROPERTY_NAME;
-	union acpi_object *element;
-	acpi_object_type type;
-	char *string;
-	u32 value;
-	int err;
-
-	err = check_platform_events_wobj(wobj);
-	if (err)
-		return err;
+	struct hp_wmi_group *group = &state->groups[type];
+	struct hp_wmi_reading *reading = state->reading_map[type];
+	struct hp_wmi_info *info;
+	u16 i;
 
-	element = wobj->package.elements;
+	if (!reading)
+		return;
 
-	for (; prop <= last_prop; prop++, element++) {
-		type = hp_wmi_platform_events_property_map[prop];
+	mutex_lock(&group->lock);
 
-		err = extract_acpi_value(dev, element, type, &value, &string);
-		if (err)
-			return err;
+	for (i = 0; i < state->channel_count[type]; i++, reading++) {
+		if (!hp_wmi_has_limits(state, reading) ||
+		    !hp_wmi_reading_expires(state, reading, margin))
+			continue;
 
-		switch (prop) {
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_NAME:
-			pevents->name = string;
-			break;
+		info = hp_wmi_reading_info(state, reading);
+		hp_wmi_refresh_info(state, info);
+	}
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_DESCRIPTION:
-			pevents->description = string;
-			break;
+	mutex_unlock(&group->lock);
+}
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_SOURCE_NAMESPACE:
-			if (strcasecmp(HP_WMI_EVENT_NAMESPACE, string))
-				return -EINVAL;
+/*
+ * hp_wmi_poll_work - background polling work function
+ * @work: pointer to work struct
+ *
+ * Without poll_interval, this runs only while a threshold is set, and
+ * then only refreshes sensors with thresholds. Otherwise, a threshold
+ * would only be checked whenever userspace happens to read the sensor.
+ */
+static void hp_wmi_poll_work(struct work_struct *work)
+{
+	struct hp_wmi_sensors *state;
+	unsigned long interval;
+
+	state = container_of(to_delayed_work(work), struct hp_wmi_sensors,
+			     poll_work);
+
+	/* Else, a lifetime equal to the interval skips every other poll. */
+	interval = state->poll_interval;
+	if (interval) {
+		hp_wmi_refresh_all(state, interval);
+	} else {
+		interval = hp_wmi_limits_interval(state);
+		if (!interval)
+			return;	/* Requeued when a threshold is next set. */
+
+		hp_wmi_refresh_limited(state, hwmon_temp, interval);
+		hp_wmi_refresh_limited(state, hwmon_fan, interval);
+	}
 
-			pevents->source_namespace = string;
-			break;
+	queue_delayed_work(system_freezable_wq, &state->poll_work, interval);
+}
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_SOURCE_CLASS:
-			if (strcasecmp(HP_WMI_EVENT_CLASS, string))
-				return -EINVAL;
+/*
+ * hp_wmi_count_matches - check that the count of sensors is as of probe
+ * @state: pointer to driver state
+ *
+ * Instances are numbered contiguously, so only the last instance found at
+ * probe and the one after it need to be polled.
+ */
+static bool hp_wmi_count_matches(const struct hp_wmi_sensors *state)
+{
+	u16 icount = state->icount;
+	struct acpi_buffer out;
 
-			pevents->source_class = string;
-			break;
+	if (!hp_wmi_query_wobj(HP_WMI_NUMERIC_SENSOR_GUID, icount - 1, &out))
+		return false;
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_CATEGORY:
-			pevents->category = value;
-			break;
+	kfree(out.pointer);
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_SEVERITY:
-			pevents->possible_severity = value;
-			break;
+	if (icount == HP_WMI_MAX_INSTANCES)
+		return true;
 
-		case HP_WMI_PLATFORM_EVENTS_PROPERTY_POSSIBLE_STATUS:
-			pevents->possible_status = value;
-			break;
+	if (!hp_wmi_query_wobj(HP_WMI_NUMERIC_SENSOR_GUID, icount, &out))
+		return true;
 
-		default:
-			return -EINVAL;
-		}
-	}
+	kfree(out.pointer);
 
-	return 0;
+	return false;
 }
 
 /*
- * check_event_wobj - validate a HPBIOS_BIOSEvent instance
- * @wobj: pointer to WMI object instance to check
+ * hp_wmi_resume_work - revalidate and refresh sensors after resume
+ * @work: pointer to work struct
  *
- * Returns 0 on success, or a negative error code on error.
+ * What was found at probe is kept as long as the firmware still matches
+ * it. The count of sensors is checked here, and each sensor's Name is
+ * checked as it is refreshed. Refreshing all sensors in the background
+ * spares the first readers after resume from waiting on WMI.
  */
-static int check_event_wobj(const union acpi_object *wobj)
+static void hp_wmi_resume_work(struct work_struct *work)
 {
-	return check_wobj(wobj, hp_wmi_event_property_map,
-			  HP_WMI_EVENT_PROPERTY_STATUS);
+	struct hp_wmi_sensors *state;
+
+	state = container_of(work, struct hp_wmi_sensors, resume_work);
+
+	if (!hp_wmi_count_matches(state))
+		hp_wmi_topology_changed(state);
+
+	hp_wmi_refresh_all(state, 0);
+
+	clear_bit(0, &state->resuming);
 }
 
-static int populate_event_from_wobj(struct device *dev,
-				    struct hp_wmi_event *event,
-				    union acpi_object *wobj)
+static void sensors_show_one(struct seq_file *seqf, u8 instance,
+			     const struct hp_wmi_numeric_sensor *nsensor,
+			     bool is_new)
 {
-	int prop = HP_WMI_EVENT_PROPERTY_NAME;
-	union acpi_object *element;
-	acpi_object_type type;
-	char *string;
-	u32 value;
-	int err;
+	u8 i;
 
-	err = check_event_wobj(wobj);
-	if (err)
-		return err;
+	seq_printf(seqf, "[%u]\n", instance);
+	seq_printf(seqf, "name: %s\n", nsensor->name);
+	seq_printf(seqf, "description: %s\n", nsensor->description);
+	seq_printf(seqf, "sensor_type: %u\n", nsensor->sensor_type);
+	seq_printf(seqf, "other_sensor_type: %s\n",
+		   nsensor->other_sensor_type);
+	seq_printf(seqf, "operational_status: %u\n",
+		   nsensor->operational_status);
 
-	element = wobj->package.elements;
+	seq_puts(seqf, "possible_states: ");
+	for (i = 0; i < nsensor->size; i++)
+		seq_printf(seqf, "%s%s", i ? "," : "",
+			   nsensor->possible_states[i]);
+	seq_puts(seqf, "\n");
 
-	for (; prop <= HP_WMI_EVENT_PROPERTY_CATEGORY; prop++, element++) {
-		type = hp_wmi_event_property_map[prop];
+	seq_printf(seqf, "current_state: %s\n",
+		   nsensor->possible_states[nsensor->current_state]);
+	seq_printf(seqf, "base_units: %u\n", nsensor->base_units);
+	seq_printf(seqf, "unit_modifier: %d\n", nsensor->unit_modifier);
+	seq_printf(seqf, "current_reading: %u\n", nsensor->current_reading);
 
-		err = extract_acpi_value(dev, element, type, &value, &string);
-		if (err)
-			return err;
+	if (is_new)
+		seq_printf(seqf, "rate_units: %u\n", nsensor->rate_units);
+}
 
-		switch (prop) {
-		case HP_WMI_EVENT_PROPERTY_NAME:
-			event->name = string;
-			break;
+/*
+ * sensors_show_slim - show all sensors, rebuilt from freshly polled WMI
+ *
+ * In slim mode, the properties shown are not all kept after probe, so each
+ * sensor is polled and populated anew, then the result freed again.
+ */
+static int sensors_show_slim(struct seq_file *seqf,
+			     struct hp_wmi_sensors *state)
+{
+	struct hp_wmi_numeric_sensor nsensor;
+	struct hp_wmi_numeric_layout layout;
+	struct acpi_buffer out;
+	int err;
+	u16 i;
 
-		case HP_WMI_EVENT_PROPERTY_DESCRIPTION:
-			event->description = string;
-			break;
+	for (i = 0; i < state->icount; i++) {
+		if (!hp_wmi_query_wobj(HP_WMI_NUMERIC_SENSOR_GUID, i, &out))
+			continue;
 
-		case HP_WMI_EVENT_PROPERTY_CATEGORY:
-			event->category = value;
-			break;
+		memset(&nsensor, 0, sizeof(nsensor));
 
-		default:
-			return -EINVAL;
-		}
+		/* Unmanaged; see hp_wmi_kcalloc(). */
+		err = populate_numeric_sensor_from_wobj(NULL, &nsensor,
+							&layout, out.pointer);
+		if (!err)
+			sensors_show_one(seqf, i, &nsensor, layout.is_new);
+
+		put_numeric_sensor(NULL, &nsensor);
+		kfree(out.pointer);
 	}
 
 	return 0;
 }
 
 /*
- * classify_event - classify an event
- * @name: event name
- * @category: event category
+ * sensors_show - show all sensors, refreshing them first if stale
  *
- * Classify instances of both HPBIOS_PlatformEvents and HPBIOS_BIOSEvent from
- * property values. Recognition criteria are based on multiple ACPI dumps [3].
- *
- * Returns an enum hp_wmi_type value on success,
- * or a negative value if the event type is unsupported.
+ * Errors are ignored; a sensor that fails to refresh is shown as of its
+ * last successful refresh.
  */
-static int classify_event(const char *event_name, u32 category)
+static int sensors_show(struct seq_file *seqf, void *ignored)
 {
-	if (category != HP_WMI_CATEGORY_SENSOR)
-		return -EINVAL;
+	struct hp_wmi_sensors *state = seqf->private;
+	struct hp_wmi_group *group;
+	struct hp_wmi_info *info;
+	u16 i;
 
-	/* Fan events have Name "X Stall". */
-	if (strstr(event_name, HP_WMI_PATTERN_FAN_ALARM))
-		return HP_WMI_TYPE_AIR_FLOW;
+	if (slim)
+		return sensors_show_slim(seqf, state);
 
-	/* Intrusion events have Name "Hood Intrusion". */
-	if (!strcmp(event_name, HP_WMI_PATTERN_INTRUSION_ALARM))
-		return HP_WMI_TYPE_INTRUSION;
+	for (i = 0, info = state->info; i < state->icount; i++, info++) {
+		hp_wmi_update_info(state, info);
 
-	/*
-	 * Temperature events have Name either "Thermal Caution" or
-	 * "Thermal Critical". Deal only with "Thermal Critical" events.
-	 *
-	 * "Thermal Caution" events have Status "Stressed", informing us that
-	 * the OperationalStatus of the related sensor has become "Stressed".
-	 * However, this is already a fault condition that will clear itself
-	 * when the sensor recovers, so we have no further interest in them.
-	 */
-	if (!strcmp(event_name, HP_WMI_PATTERN_TEMP_ALARM))
-		return HP_WMI_TYPE_TEMPERATURE;
+		group = &state->groups[info->type];
+
+		mutex_lock(&group->lock);
+		sensors_show_one(seqf, i, &info->nsensor, info->layout.is_new);
+		mutex_unlock(&group->lock);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sensors);
+
+static void
+platform_events_show_all(struct seq_file *seqf,
+			 const struct hp_wmi_platform_events *pevents,
+			 u16 count)
+{
+	u16 i;
+
+	for (i = 0; i < count; i++, pevents++) {
+		seq_printf(seqf, "[%u]\n", i);
+		seq_printf(seqf, "name: %s\n", pevents->name);
+		seq_printf(seqf, "description: %s\n", pevents->description);
+		seq_printf(seqf, "source_namespace: %s\n",
+			   pevents->source_namespace);
+		seq_printf(seqf, "source_class: %s\n", pevents->source_class);
+		seq_printf(seqf, "category: %u\n", pevents->category);
+		seq_printf(seqf, "possible_severity: %u\n",
+			   pevents->possible_severity);
+		seq_printf(seqf, "possible_status: %u\n",
+			   pevents->possible_status);
+	}
+}
 
-	return -EINVAL;
+static int platform_events_show(struct seq_file *seqf, void *ignored)
+{
+	struct hp_wmi_sensors *state = seqf->private;
+	struct hp_wmi_platform_events *pevents = NULL;
+	u16 pcount = 0;
+	int err;
+
+	if (!slim) {
+		platform_events_show_all(seqf, state->pevents, state->pcount);
+		return 0;
+	}
+
+	/* In slim mode, platform events objects are rebuilt on demand. */
+	err = init_platform_events(NULL, &pevents, &pcount);
+	if (!err)
+		platform_events_show_all(seqf, pevents, pcount);
+
+	put_platform_events(NULL, pevents, pcount);
+
+	return err;
 }
+DEFINE_SHOW_ATTRIBUTE(platform_events);
 
-/*
- * interpret_info - interpret sensor for hwmon
- * @info: pointer to sensor info struct
- *
- * Should be called after the numeric sensor member has been updated.
- */
-static void interpret_info(struct hp_wmi_info *info)
+static const char * const hp_wmi_snapshot_prefixes[hwmon_max] = {
+	[hwmon_temp] = "temp",
+	[hwmon_in]   = "in",
+	[hwmon_curr] = "curr",
+	[hwmon_fan]  = "fan",
+};
+
+static void snapshot_show_group(struct seq_file *seqf,
+				struct hp_wmi_sensors *state,
+				enum hwmon_sensor_types type)
 {
-	const struct hp_wmi_numeric_sensor *nsensor = &info->nsensor;
+	const struct hp_wmi_reading *reading = state->reading_map[type];
+	const struct hp_wmi_numeric_sensor *nsensor;
+	const struct hp_wmi_info *info;
+	unsigned long now = jiffies;
+	int base;
+	u16 i;
+
+	/* Channel numbers in sysfs are 0-based only for voltage sensors. */
+	base = type == hwmon_in ? 0 : 1;
+
+	for (i = 0; i < state->channel_count[type]; i++, reading++) {
+		info = hp_wmi_reading_info(state, reading);
+		nsensor = &info->nsensor;
 
-	info->cached_val = scale_numeric_sensor(nsensor);
-	info->last_updated = jiffies;
+		seq_printf(seqf, "%s%d %ld %u %d %u %d %d %u %s\n",
+			   hp_wmi_snapshot_prefixes[type], i + base,
+			   reading->cached_val, nsensor->current_reading,
+			   nsensor->unit_modifier, nsensor->operational_status,
+			   reading->fault, test_bit(i, state->alarms[type]),
+			   jiffies_to_msecs(now - reading->last_updated),
+			   nsensor->name);
+	}
 }
 
 /*
- * hp_wmi_update_info - poll WMI to update sensor info
- * @state: pointer to driver state
- * @info: pointer to sensor info struct
+ * snapshot_show - show all hwmon channels as of one batched refresh
  *
- * Returns 0 on success, or a negative error code on error.
+ * Each hwmon type is refreshed and shown under its group lock, so that all
+ * readings of a type are mutually consistent.
  */
-static int hp_wmi_update_info(struct hp_wmi_sensors *state,
-			      struct hp_wmi_info *info)
+static int snapshot_show(struct seq_file *seqf, void *ignored)
 {
-	struct hp_wmi_numeric_sensor *nsensor = &info->nsensor;
-	struct device *dev = &state->wdev->dev;
-	const union acpi_object *wobj;
-	u8 instance = info->instance;
-	int ret = 0;
+	struct hp_wmi_sensors *state = seqf->private;
+	enum hwmon_sensor_types type;
+	struct hp_wmi_group *group;
 
-	if (time_after(jiffies, info->last_updated + HZ)) {
-		mutex_lock(&state->lock);
+	seq_puts(seqf, "# channel value reading unit_modifier ");
+	seq_puts(seqf, "operational_status fault alarm age_ms label\n");
 
-		wobj = hp_wmi_get_wobj(HP_WMI_NUMERIC_SENSOR_GUID, instance);
-		if (!wobj) {
-			ret = -EIO;
-			goto out_unlock;
-		}
+	for (type = hwmon_chip; type < hwmon_max; type++) {
+		if (!state->reading_map[type])
+			continue;
 
-		update_numeric_sensor_from_wobj(dev, nsensor, wobj);
+		group = &state->groups[type];
 
-		interpret_info(info);
+		mutex_lock(&group->lock);
 
-		kfree(wobj);
+		hp_wmi_refresh_group(state, type, 0);
+		snapshot_show_group(seqf, state, type);
 
-out_unlock:
-		mutex_unlock(&state->lock);
+		mutex_unlock(&group->lock);
 	}
 
-	return ret;
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(snapshot);
 
-static int basic_string_show(struct seq_file *seqf, void *ignored)
+/* raw_show - show the dumps of all WMI object instances together */
+static int raw_show(struct seq_file *seqf, void *ignored)
 {
-	const char *str = seqf->private;
+	struct hp_wmi_sensors *state = seqf->private;
+	struct hp_wmi_group *group;
+	struct hp_wmi_info *info;
+	struct acpi_buffer out;
+	size_t size;
+	char *buf;
+	u16 i;
 
-	seq_printf(seqf, "%s\n", str);
+	if (!slim)
+		goto show_cached;
 
-	return 0;
-}
-DEFINE_SHOW_ATTRIBUTE(basic_string);
+	/* In slim mode, dumps are not kept, so poll WMI for them here. */
+	buf = kmalloc(HP_WMI_RAW_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
 
-static int fungible_show(struct seq_file *seqf, enum hp_wmi_property prop)
-{
-	struct hp_wmi_numeric_sensor *nsensor;
-	struct hp_wmi_sensors *state;
-	struct hp_wmi_info *info;
-	int err;
+	for (i = 0; i < state->icount; i++) {
+		if (!hp_wmi_query_wobj(HP_WMI_NUMERIC_SENSOR_GUID, i, &out))
+			continue;
 
-	info = seqf->private;
-	state = info->state;
-	nsensor = &info->nsensor;
+		size = serialize_wobj(out.pointer, buf, HP_WMI_RAW_SIZE);
+		kfree(out.pointer);
 
-	err = hp_wmi_update_info(state, info);
-	if (err)
-		return err;
+		seq_printf(seqf, "[%u]\n", i);
+		seq_write(seqf, buf, size);
+	}
 
-	switch (prop) {
-	case HP_WMI_PROPERTY_OPERATIONAL_STATUS:
-		seq_printf(seqf, "%u\n", nsensor->operational_status);
-		break;
+	kfree(buf);
 
-	case HP_WMI_PROPERTY_CURRENT_STATE:
-		seq_printf(seqf, "%s\n", nsensor->current_state);
-		break;
+	return 0;
 
-	case HP_WMI_PROPERTY_UNIT_MODIFIER:
-		seq_printf(seqf, "%d\n", nsensor->unit_modifier);
-		break;
+show_cached:
+	for (i = 0, info = state->info; i < state->icount; i++, info++) {
+		group = &state->groups[info->type];
 
-	case HP_WMI_PROPERTY_CURRENT_READING:
-		seq_printf(seqf, "%u\n", nsensor->current_reading);
-		break;
+		mutex_lock(&group->lock);
 
-	default:
-		return -EOPNOTSUPP;
+		seq_printf(seqf, "[%u]\n", i);
+		seq_write(seqf, info->raw, info->raw_size);
+
+		mutex_unlock(&group->lock);
 	}
 
 	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(raw);
+
+/*
+ * The history file is a binary file of struct hp_wmi_sample records,
+ * grouped by channel and oldest first within a channel. Each ->show()
+ * emits one channel, so that seq_file only ever needs to buffer one.
+ */
+
+static void *history_start(struct seq_file *seqf, loff_t *pos)
+{
+	struct hp_wmi_sensors *state = seqf->private;
+
+	return *pos < state->icount ? &state->info[*pos] : NULL;
+}
 
-static int operational_status_show(struct seq_file *seqf, void *ignored)
+static void *history_next(struct seq_file *seqf, void *v, loff_t *pos)
 {
-	return fungible_show(seqf, HP_WMI_PROPERTY_OPERATIONAL_STATUS);
+	++*pos;
+
+	return history_start(seqf, pos);
 }
-DEFINE_SHOW_ATTRIBUTE(operational_status);
 
-static int current_state_show(struct seq_file *seqf, void *ignored)
+static void history_stop(struct seq_file *seqf, void *v)
 {
-	return fungible_show(seqf, HP_WMI_PROPERTY_CURRENT_STATE);
 }
-DEFINE_SHOW_ATTRIBUTE(current_state);
 
-static int possible_states_show(struct seq_file *seqf, void *ignored)
+static int history_show(struct seq_file *seqf, void *v)
 {
-	struct hp_wmi_numeric_sensor *nsensor = seqf->private;
-	u8 i;
+	struct hp_wmi_sensors *state = seqf->private;
+	const struct hp_wmi_info *info = v;
+	const struct hp_wmi_history *history = &info->history;
+	const struct hp_wmi_sample *samples = history->samples;
+	struct hp_wmi_group *group = &state->groups[info->type];
+	u32 len = state->history_len;
+	u32 next;
+
+	if (!samples)
+		return 0;
 
-	for (i = 0; i < nsensor->size; i++)
-		seq_printf(seqf, "%s%s", i ? "," : "",
-			   nsensor->possible_states[i]);
+	mutex_lock(&group->lock);
 
-	seq_puts(seqf, "\n");
+	next = history->next;
+
+	if (history->count < len) {
+		seq_write(seqf, samples, history->count * sizeof(*samples));
+	} else {
+		/* The ring is full, so the oldest sample is the next to go. */
+		seq_write(seqf, &samples[next],
+			  (len - next) * sizeof(*samples));
+		seq_write(seqf, samples, next * sizeof(*samples));
+	}
+
+	mutex_unlock(&group->lock);
 
 	return 0;
 }
-DEFINE_SHOW_ATTRIBUTE(possible_states);
 
-static int unit_modifier_show(struct seq_file *seqf, void *ignored)
+static const struct seq_operations history_sops = {
+	.start = history_start,
+	.next = history_next,
+	.stop = history_stop,
+	.show = history_show,
+};
+DEFINE_SEQ_ATTRIBUTE(history);
+
+static void stats_show_info(struct seq_file *seqf,
+			    const struct hp_wmi_info *info)
+{
+	const struct hp_wmi_stats *stats = &info->stats;
+	u64 avg_ns = 0;
+	u8 i;
+
+	if (stats->queries)
+		avg_ns = div_u64(stats->total_ns, stats->queries);
+
+	seq_printf(seqf, "[%u]\n", info->instance);
+	seq_printf(seqf, "hits: %d\n", atomic_read(&stats->hits));
+	seq_printf(seqf, "misses: %d\n", atomic_read(&stats->misses));
+	seq_printf(seqf, "queries: %u\n", stats->queries);
+	seq_printf(seqf, "errors: %u\n", stats->errors);
+	seq_printf(seqf, "min_us: %llu\n", div_u64(stats->min_ns, NSEC_PER_USEC));
+	seq_printf(seqf, "avg_us: %llu\n", div_u64(avg_ns, NSEC_PER_USEC));
+	seq_printf(seqf, "max_us: %llu\n", div_u64(stats->max_ns, NSEC_PER_USEC));
+	seq_printf(seqf, "backoff: %u\n", READ_ONCE(info->reading->backoff));
+
+	seq_puts(seqf, "histogram_us:\n");
+
+	for (i = 0; i < HP_WMI_STATS_BUCKETS - 1; i++)
+		seq_printf(seqf, "  %u-%u: %u\n", i ? 1U << (i - 1) : 0,
+			   1U << i, stats->histogram[i]);
+
+	seq_printf(seqf, "  %u-: %u\n", 1U << (i - 1), stats->histogram[i]);
+}
+
+static int stats_show(struct seq_file *seqf, void *ignored)
 {
-	return fungible_show(seqf, HP_WMI_PROPERTY_UNIT_MODIFIER);
+	struct hp_wmi_sensors *state = seqf->private;
+	struct hp_wmi_group *group;
+	struct hp_wmi_info *info;
+	u16 i;
+
+	for (i = 0, info = state->info; i < state->icount; i++, info++) {
+		group = &state->groups[info->type];
+
+		mutex_lock(&group->lock);
+		stats_show_info(seqf, info);
+		mutex_unlock(&group->lock);
+	}
+
+	return 0;
 }
-DEFINE_SHOW_ATTRIBUTE(unit_modifier);
+DEFINE_SHOW_ATTRIBUTE(stats);
 
-static int current_reading_show(struct seq_file *seqf, void *ignored)
+static int events_show(struct seq_file *seqf, void *ignored)
 {
-	return fungible_show(seqf, HP_WMI_PROPERTY_CURRENT_READING);
+	struct hp_wmi_sensors *state = seqf->private;
+	struct hp_wmi_event_stats *event_stats = &state->event_stats;
+
+	seq_printf(seqf, "received: %d\n", atomic_read(&event_stats->received));
+	seq_printf(seqf, "decoded: %d\n", atomic_read(&event_stats->decoded));
+	seq_printf(seqf, "coalesced: %d\n",
+		   atomic_read(&event_stats->coalesced));
+	seq_printf(seqf, "matched: %d\n", atomic_read(&event_stats->matched));
+	seq_printf(seqf, "dropped: %d\n", atomic_read(&event_stats->dropped));
+
+	return 0;
 }
-DEFINE_SHOW_ATTRIBUTE(current_reading);
+DEFINE_SHOW_ATTRIBUTE(events);
 
 /* hp_wmi_devm_debugfs_remove - devm callback for debugfs cleanup */
 static void hp_wmi_devm_debugfs_remove(void *res)
@@ -1324,18 +3765,19 @@ static void hp_wmi_devm_debugfs_remove(void *res)
 	debugfs_remove_recursive(res);
 }
 
-/* hp_wmi_debugfs_init - create and populate debugfs directory tree */
-static void hp_wmi_debugfs_init(struct device *dev, struct hp_wmi_info *info,
-				struct hp_wmi_platform_events *pevents,
-				u8 icount, u8 pcount, bool is_new)
+/*
+ * hp_wmi_debugfs_init - create and populate debugfs directory
+ *
+ * Each file holds one record per sensor or platform events object, rather
+ * than each record having a directory of its own, to keep the number of
+ * dentries and inodes small and independent of the number of sensors.
+ */
+static void hp_wmi_debugfs_init(struct hp_wmi_sensors *state)
 {
-	struct hp_wmi_numeric_sensor *nsensor;
+	struct device *dev = state->dev;
 	char buf[HP_WMI_MAX_STR_SIZE];
 	struct dentry *debugfs;
-	struct dentry *entries;
-	struct dentry *dir;
 	int err;
-	u8 i;
 
 	/* dev_name() gives a not-very-friendly GUID for WMI devices. */
 	scnprintf(buf, sizeof(buf), "hp-wmi-sensors-%u", dev->id);
@@ -1349,86 +3791,19 @@ static void hp_wmi_debugfs_init(struct device *dev, struct hp_wmi_info *info,
 	if (err)
 		return;
 
-	entries = debugfs_create_dir("sensor", debugfs);
-
-	for (i = 0; i < icount; i++, info++) {
-		nsensor = &info->nsensor;
-
-		scnprintf(buf, sizeof(buf), "%u", i);
-		dir = debugfs_create_dir(buf, entries);
-
-		debugfs_create_file("name", 0444, dir,
-				    (void *)nsensor->name,
-				    &basic_string_fops);
-
-		debugfs_create_file("description", 0444, dir,
-				    (void *)nsensor->description,
-				    &basic_string_fops);
-
-		debugfs_create_u32("sensor_type", 0444, dir,
-				   &nsensor->sensor_type);
-
-		debugfs_create_file("other_sensor_type", 0444, dir,
-				    (void *)nsensor->other_sensor_type,
-				    &basic_string_fops);
-
-		debugfs_create_file("operational_status", 0444, dir,
-				    info, &operational_status_fops);
-
-		debugfs_create_file("possible_states", 0444, dir,
-				    nsensor, &possible_states_fops);
-
-		debugfs_create_file("current_state", 0444, dir,
-				    info, &current_state_fops);
-
-		debugfs_create_u32("base_units", 0444, dir,
-				   &nsensor->base_units);
-
-		debugfs_create_file("unit_modifier", 0444, dir,
-				    info, &unit_modifier_fops);
-
-		debugfs_create_file("current_reading", 0444, dir,
-				    info, &current_reading_fops);
-
-		if (is_new)
-			debugfs_create_u32("rate_units", 0444, dir,
-					   &nsensor->rate_units);
-	}
-
-	if (!pcount)
-		return;
-
-	entries = debugfs_create_dir("platform_events", debugfs);
-
-	for (i = 0; i < pcount; i++, pevents++) {
-		scnprintf(buf, sizeof(buf), "%u", i);
-		dir = debugfs_create_dir(buf, entries);
-
-		debugfs_create_file("name", 0444, dir,
-				    (void *)pevents->name,
-				    &basic_string_fops);
-
-		debugfs_create_file("description", 0444, dir,
-				    (void *)pevents->description,
-				    &basic_string_fops);
-
-		debugfs_create_file("source_namespace", 0444, dir,
-				    (void *)pevents->source_namespace,
-				    &basic_string_fops);
-
-		debugfs_create_file("source_class", 0444, dir,
-				    (void *)pevents->source_class,
-				    &basic_string_fops);
-
-		debugfs_create_u32("category", 0444, dir,
-				   &pevents->category);
+	debugfs_create_file("sensors", 0444, debugfs, state, &sensors_fops);
+	debugfs_create_file("snapshot", 0444, debugfs, state, &snapshot_fops);
+	debugfs_create_file("stats", 0444, debugfs, state, &stats_fops);
+	debugfs_create_file("raw", 0444, debugfs, state, &raw_fops);
+	debugfs_create_file("events", 0444, debugfs, state, &events_fops);
 
-		debugfs_create_u32("possible_severity", 0444, dir,
-				   &pevents->possible_severity);
+	if (state->history_len)
+		debugfs_create_file("history", 0444, debugfs, state,
+				    &history_fops);
 
-		debugfs_create_u32("possible_status", 0444, dir,
-				   &pevents->possible_status);
-	}
+	if (state->pcount)
+		debugfs_create_file("platform_events", 0444, debugfs, state,
+				    &platform_events_fops);
 }
 
 static umode_t hp_wmi_hwmon_is_visible(const void *drvdata,
@@ -1436,19 +3811,21 @@ static umode_t hp_wmi_hwmon_is_visible(const void *drvdata,
 				       u32 attr, int channel)
 {
 	const struct hp_wmi_sensors *state = drvdata;
-	const struct hp_wmi_info *info;
+
+	if (type == hwmon_chip)
+		return attr == hwmon_chip_update_interval ? 0644 : 0;
 
 	if (type == hwmon_intrusion)
 		return state->has_intrusion ? 0644 : 0;
 
-	if (!state->info_map[type] || !state->info_map[type][channel])
+	if (!state->reading_map[type] || channel >= state->channel_count[type])
 		return 0;
 
-	info = state->info_map[type][channel];
+	if (hp_wmi_is_limit(type, attr))
+		return 0644;
 
-	if ((type == hwmon_temp && attr == hwmon_temp_alarm) ||
-	    (type == hwmon_fan  && attr == hwmon_fan_alarm))
-		return info->has_alarm ? 0444 : 0;
+	if (hp_wmi_is_reset_history(type, attr))
+		return 0200;
 
 	return 0444;
 }
@@ -1457,39 +3834,62 @@ static int hp_wmi_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
 			     u32 attr, int channel, long *out_val)
 {
 	struct hp_wmi_sensors *state = dev_get_drvdata(dev);
-	const struct hp_wmi_numeric_sensor *nsensor;
+	struct hp_wmi_reading *reading;
 	struct hp_wmi_info *info;
+	int kind;
 	int err;
 
-	if (type == hwmon_intrusion) {
-		*out_val = state->intrusion ? 1 : 0;
+	if (type == hwmon_chip) {
+		*out_val = READ_ONCE(state->update_interval);
 
 		return 0;
 	}
 
-	info = state->info_map[type][channel];
+	if (type == hwmon_intrusion) {
+		*out_val = test_bit(0, state->alarms[type]);
+
+		return 0;
+	}
 
 	if ((type == hwmon_temp && attr == hwmon_temp_alarm) ||
 	    (type == hwmon_fan  && attr == hwmon_fan_alarm)) {
-		*out_val = info->alarm ? 1 : 0;
-		info->alarm = false;
+		*out_val = test_and_clear_bit(channel, state->alarms[type]);
 
 		return 0;
 	}
 
-	nsensor = &info->nsensor;
+	kind = hp_wmi_limit_alarm(type, attr);
+	if (kind >= 0) {
+		*out_val = test_and_clear_bit(channel,
+					      state->limit_alarms[kind]);
 
-	err = hp_wmi_update_info(state, info);
-	if (err)
-		return err;
+		return 0;
+	}
 
-	if ((type == hwmon_temp && attr == hwmon_temp_fault) ||
-	    (type == hwmon_fan  && attr == hwmon_fan_fault))
-		*out_val = numeric_sensor_has_fault(nsensor);
-	else
-		*out_val = info->cached_val;
+	reading = &state->reading_map[type][channel];
 
-	return 0;
+	/* Thresholds are the driver's own, so reading one needs no refresh. */
+	if (hp_wmi_is_limit(type, attr)) {
+		*out_val = hp_wmi_read_limit(state, reading, type, attr);
+
+		return 0;
+	}
+
+	info = hp_wmi_reading_info(state, reading);
+
+	/*
+	 * When polling in the background, never wait for WMI here, except
+	 * for readings that were invalidated on resume and not yet refreshed.
+	 */
+	if (state->poll_interval && !test_bit(0, &state->resuming)) {
+		hp_wmi_account_hit(info);
+	} else {
+		err = hp_wmi_update_info(state, info);
+		if (err)
+			return err;
+	}
+
+	return hp_wmi_read_cached(state, reading, type, attr, out_val);
 }
 
 static int hp_wmi_hwmon_read_string(struct device *dev,
@@ -1499,7 +3899,7 @@ static int hp_wmi_hwmon_read_string(struct device *dev,
 	const struct hp_wmi_sensors *state = dev_get_drvdata(dev);
 	const struct hp_wmi_info *info;
 
-	info = state->info_map[type][channel];
+	info = hp_wmi_reading_info(state, &state->reading_map[type][channel]);
 	*out_str = info->nsensor.name;
 
 	return 0;
@@ -1509,15 +3909,61 @@ static int hp_wmi_hwmon_write(struct device *dev, enum hwmon_sensor_types type,
 			      u32 attr, int channel, long val)
 {
 	struct hp_wmi_sensors *state = dev_get_drvdata(dev);
+	struct hp_wmi_reading *reading;
+	struct hp_wmi_limits *limits;
+	struct hp_wmi_group *group;
 
-	if (val)
-		return -EINVAL;
+	if (type == hwmon_chip) {
+		val = clamp_val(val, 1, HP_WMI_MAX_UPDATE_INTERVAL);
+
+		WRITE_ONCE(state->update_interval, val);
+
+		return 0;
+	}
+
+	if (hp_wmi_is_limit(type, attr)) {
+		reading = &state->reading_map[type][channel];
+		limits = hp_wmi_reading_limits(state, reading);
+		group = &state->groups[type];
+
+		/* Serialize with hp_wmi_check_limits(). */
+		mutex_lock(&group->lock);
+
+		if (type == hwmon_fan)
+			WRITE_ONCE(limits->min, val);
+		else if (attr == hwmon_temp_max)
+			WRITE_ONCE(limits->max, val);
+		else
+			WRITE_ONCE(limits->crit, val);
+
+		mutex_unlock(&group->lock);
+
+		/* Without background polling, start checking thresholds. */
+		if (val && !state->poll_interval)
+			queue_delayed_work(system_freezable_wq,
+					   &state->poll_work, 0);
+
+		return 0;
+	}
+
+	/* Any value resets the history, as for other hwmon drivers. */
+	if (hp_wmi_is_reset_history(type, attr)) {
+		reading = &state->reading_map[type][channel];
+		group = &state->groups[type];
 
-	mutex_lock(&state->lock);
+		mutex_lock(&group->lock);
+		write_seqcount_begin(&group->seq);
+		reset_reading_history(reading);
+		write_seqcount_end(&group->seq);
+		mutex_unlock(&group->lock);
+
+		return 0;
+	}
 
-	state->intrusion = false;
+	if (val)
+		return -EINVAL;
 
-	mutex_unlock(&state->lock);
+	clear_bit(0, state->alarms[type]);
 
 	return 0;
 }
@@ -1537,16 +3983,16 @@ static struct hwmon_chip_info hp_wmi_chip_info = {
 static struct hp_wmi_info *match_fan_event(struct hp_wmi_sensors *state,
 					   const char *event_description)
 {
-	struct hp_wmi_info **ptr_info = state->info_map[hwmon_fan];
-	u8 fan_count = state->channel_count[hwmon_fan];
+	struct hp_wmi_reading *reading = state->reading_map[hwmon_fan];
+	u16 fan_count = state->channel_count[hwmon_fan];
 	struct hp_wmi_info *info;
 	const char *name;
-	u8 i;
+	u16 i;
 
 	/* Fan event has Description "X Speed". Sensor has Name "X[ Speed]". */
 
-	for (i = 0; i < fan_count; i++, ptr_info++) {
-		info = *ptr_info;
+	for (i = 0; i < fan_count; i++, reading++) {
+		info = hp_wmi_reading_info(state, reading);
 		name = info->nsensor.name;
 
 		if (strstr(event_description, name))
@@ -1556,18 +4002,26 @@ static struct hp_wmi_info *match_fan_event(struct hp_wmi_sensors *state,
 	return NULL;
 }
 
-static u8 match_temp_events(struct hp_wmi_sensors *state,
-			    const char *event_description,
-			    struct hp_wmi_info *temp_info[])
+/*
+ * match_temp_events - find temperature channels related to an event
+ * @state: pointer to driver state
+ * @event_description: Description of the event
+ * @channels: bitmap of HP_WMI_MAX_INSTANCES bits to receive the channels
+ *
+ * Returns the count of channels found.
+ */
+static u16 match_temp_events(struct hp_wmi_sensors *state,
+			     const char *event_description,
+			     unsigned long *channels)
 {
-	struct hp_wmi_info **ptr_info = state->info_map[hwmon_temp];
-	u8 temp_count = state->channel_count[hwmon_temp];
+	struct hp_wmi_reading *reading = state->reading_map[hwmon_temp];
+	u16 temp_count = state->channel_count[hwmon_temp];
 	struct hp_wmi_info *info;
 	const char *name;
-	u8 count = 0;
+	u16 count = 0;
 	bool is_cpu;
 	bool is_sys;
-	u8 i;
+	u16 i;
 
 	/* Description is either "CPU Thermal Index" or "Chassis Thermal Index". */
 
@@ -1584,45 +4038,204 @@ static u8 match_temp_events(struct hp_wmi_sensors *state,
 	 * "Chassis Thermal Index" or "System Ambient Temperature".
 	 */
 
-	for (i = 0; i < temp_count; i++, ptr_info++) {
-		info = *ptr_info;
+	for (i = 0; i < temp_count; i++, reading++) {
+		info = hp_wmi_reading_info(state, reading);
 		name = info->nsensor.name;
 
 		if ((is_cpu && (!strcmp(name, HP_WMI_PATTERN_CPU_TEMP) ||
 				!strcmp(name, HP_WMI_PATTERN_CPU_TEMP2))) ||
 		    (is_sys && (!strcmp(name, HP_WMI_PATTERN_SYS_TEMP) ||
 				!strcmp(name, HP_WMI_PATTERN_SYS_TEMP2)))) {
-			temp_info[0] = info;
+			bitmap_zero(channels, HP_WMI_MAX_INSTANCES);
+			__set_bit(i, channels);
 			return 1;
 		}
 
-		if (is_cpu && (strstr(name, HP_WMI_PATTERN_CPU) &&
-			       strstr(name, HP_WMI_PATTERN_TEMP)))
-			temp_info[count++] = info;
-	}
+		if (is_cpu && (strstr(name, HP_WMI_PATTERN_CPU) &&
+			       strstr(name, HP_WMI_PATTERN_TEMP))) {
+			__set_bit(i, channels);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* hp_wmi_devm_poll_cancel - devm callback for background polling cleanup */
+static void hp_wmi_devm_poll_cancel(void *res)
+{
+	cancel_delayed_work_sync(res);
+}
+
+/* hp_wmi_devm_notify_cancel - devm callback for notification cleanup */
+static void hp_wmi_devm_notify_cancel(void *res)
+{
+	struct hp_wmi_sensors *state = res;
+
+	WRITE_ONCE(state->hwdev, NULL);
+	cancel_work_sync(&state->notify_work);
+}
+
+/* hp_wmi_devm_event_cancel - devm callback for event dispatch cleanup */
+static void hp_wmi_devm_event_cancel(void *res)
+{
+	cancel_work_sync(res);
+}
+
+/* hp_wmi_devm_resume_cancel - devm callback for resume work cleanup */
+static void hp_wmi_devm_resume_cancel(void *res)
+{
+	cancel_work_sync(res);
+}
+
+/* hp_wmi_devm_notify_remove - devm callback for WMI event handler removal */
+static void hp_wmi_devm_notify_remove(void *ignored)
+{
+	hp_wmi_ops->remove_notify_handler(HP_WMI_EVENT_GUID);
+}
+
+/*
+ * hp_wmi_refresh_channel - refresh a hwmon channel right away
+ * @state: pointer to driver state
+ * @type: hwmon sensor type
+ * @channel: hwmon channel number
+ *
+ * Used after an event raises an alarm, so that the reading and fault flag
+ * agree with the alarm by the time userspace is notified. Should the
+ * refresh fail, the reading is left stale so that the next read retries.
+ */
+static void hp_wmi_refresh_channel(struct hp_wmi_sensors *state,
+				   enum hwmon_sensor_types type, u8 channel)
+{
+	struct hp_wmi_group *group = &state->groups[type];
+	struct hp_wmi_reading *reading;
+	struct hp_wmi_info *info;
+
+	if (!state->reading_map[type])
+		return;
+
+	reading = &state->reading_map[type][channel];
+	info = hp_wmi_reading_info(state, reading);
+
+	mutex_lock(&group->lock);
+
+	if (hp_wmi_refresh_info(state, info))
+		reading->last_updated = jiffies - LONG_MAX;
+
+	/*
+	 * Sample an alarmed sensor closely again. This must follow the
+	 * refresh, as hp_wmi_adapt() backs off a reading that is unchanged.
+	 */
+	WRITE_ONCE(reading->backoff, 0);
+
+	mutex_unlock(&group->lock);
+}
+
+/* hp_wmi_dispatch_event - raise the alarms routed to from an event */
+static void hp_wmi_dispatch_event(struct hp_wmi_sensors *state,
+				  const struct hp_wmi_event *event)
+{
+	struct hp_wmi_route *route;
+	unsigned long channel;
+	bool matched = false;
+	u32 key;
+
+	if (event->category != HP_WMI_CATEGORY_SENSOR)
+		return;
+
+	key = hp_wmi_event_hash(event->name, event->description);
+
+	hash_for_each_possible(state->routes, route, node, key) {
+		if (route->key != key || strcmp(route->name, event->name) ||
+		    strcmp(route->description, event->description))
+			continue;
+
+		for_each_set_bit(channel, route->channels,
+				 HP_WMI_MAX_INSTANCES) {
+			set_bit(channel, state->alarms[route->type]);
+			hp_wmi_refresh_channel(state, route->type, channel);
+			hp_wmi_queue_notify(state, HP_WMI_NOTIFY_ALARM,
+					    route->type, channel);
+		}
+
+		matched = true;
+	}
+
+	if (matched)
+		atomic_inc(&state->event_stats.matched);
+
+	trace_hp_wmi_sensors_dispatch(event->name, event->description, matched);
+}
+
+/* hp_wmi_put_raw_event - free WMI event data, or return it to the pool */
+static void hp_wmi_put_raw_event(struct hp_wmi_sensors *state,
+				 const struct hp_wmi_raw_event *raw)
+{
+	if (!raw->pooled) {
+		kfree(raw->wobj);
+		return;
+	}
+
+	spin_lock(&state->event_lock);
+
+	/* There is always room, as the pool started out with every buffer. */
+	kfifo_put(&state->event_bufs, raw->wobj);
+
+	spin_unlock(&state->event_lock);
+}
+
+static void hp_wmi_event_work(struct work_struct *work)
+{
+	struct hp_wmi_sensors *state;
+	struct hp_wmi_raw_event raw;
+	struct hp_wmi_event prev;
+	bool has_prev = false;
+	int err;
+
+	state = container_of(work, struct hp_wmi_sensors, event_work);
+
+	/* Only this work dequeues events, so no lock is needed. */
+	while (kfifo_get(&state->events, &raw)) {
+		/* Zeroed, so that identical events compare equal in full. */
+		struct hp_wmi_event event = {};
+
+		err = populate_event_from_wobj(&event, raw.wobj);
+		if (err)
+			dev_warn(state->dev, "Bad event data (ACPI type %d)\n",
+				 raw.wobj->type);
+
+		hp_wmi_put_raw_event(state, &raw);
+
+		if (err)
+			continue;
+
+		atomic_inc(&state->event_stats.decoded);
 
-	return count;
-}
+		trace_hp_wmi_sensors_event(event.name, event.description,
+					   event.category, 0);
 
-/* hp_wmi_devm_debugfs_remove - devm callback for WMI event handler removal */
-static void hp_wmi_devm_notify_remove(void *ignored)
-{
-	wmi_remove_notify_handler(HP_WMI_EVENT_GUID);
+		/* Collapse runs of identical events, e.g. during a storm. */
+		if (has_prev && !memcmp(&event, &prev, sizeof(event))) {
+			atomic_inc(&state->event_stats.coalesced);
+			continue;
+		}
+
+		hp_wmi_dispatch_event(state, &event);
+
+		prev = event;
+		has_prev = true;
+	}
 }
 
 /* hp_wmi_notify - WMI event notification handler */
 static void hp_wmi_notify(u32 value, void *context)
 {
-	struct hp_wmi_info *temp_info[HP_WMI_MAX_INSTANCES] = {};
-	struct acpi_buffer out = { ACPI_ALLOCATE_BUFFER, NULL };
 	struct hp_wmi_sensors *state = context;
-	struct device *dev = &state->wdev->dev;
-	struct hp_wmi_event event = {};
-	struct hp_wmi_info *fan_info;
-	union acpi_object *wobj;
-	acpi_status err;
-	int event_type;
-	u8 count;
+	struct device *dev = state->dev;
+	struct hp_wmi_raw_event raw;
+	struct acpi_buffer out;
+	acpi_status ret;
+	bool queued;
 
 	/*
 	 * The following warning may occur in the kernel log:
@@ -1644,144 +4257,168 @@ static void hp_wmi_notify(u32 value, void *context)
 	 * HPBIOS_BIOSEvent instance.
 	 */
 
-	mutex_lock(&state->lock);
+	atomic_inc(&state->event_stats.received);
 
-	err = wmi_get_event_data(value, &out);
-	if (ACPI_FAILURE(err))
-		goto out_unlock;
+	/*
+	 * Event data is only guaranteed to be available for the duration of
+	 * the notification, so it is fetched here, but decoding and dispatch
+	 * are left to hp_wmi_event_work(), so as not to hold up the ACPI
+	 * notify queue. ACPI may run notify handlers concurrently, so each
+	 * gets a buffer of its own from the pool. Should the pool be empty or
+	 * a buffer too small, which is not expected to happen, ACPI allocates
+	 * one instead.
+	 */
+	spin_lock(&state->event_lock);
 
-	wobj = out.pointer;
+	raw.pooled = kfifo_get(&state->event_bufs, &out.pointer);
 
-	err = populate_event_from_wobj(dev, &event, wobj);
-	if (err) {
-		dev_warn(dev, "Bad event data (ACPI type %d)\n", wobj->type);
-		goto out_free_wobj;
-	}
+	spin_unlock(&state->event_lock);
 
-	event_type = classify_event(event.name, event.category);
-	switch (event_type) {
-	case HP_WMI_TYPE_AIR_FLOW:
-		fan_info = match_fan_event(state, event.description);
-		if (fan_info)
-			fan_info->alarm = true;
-		break;
+	if (raw.pooled) {
+		out.length = HP_WMI_EVENT_BUF_SIZE;
+		raw.wobj = out.pointer;
 
-	case HP_WMI_TYPE_INTRUSION:
-		state->intrusion = true;
-		break;
+		ret = hp_wmi_ops->get_event_data(value, &out);
+		if (ret == AE_BUFFER_OVERFLOW) {
+			hp_wmi_put_raw_event(state, &raw);
+			raw.pooled = false;
+		}
+	}
 
-	case HP_WMI_TYPE_TEMPERATURE:
-		count = match_temp_events(state, event.description, temp_info);
-		while (count)
-			temp_info[--count]->alarm = true;
-		break;
+	if (!raw.pooled) {
+		out.length = ACPI_ALLOCATE_BUFFER;
+		out.pointer = NULL;
 
-	default:
-		break;
+		ret = hp_wmi_ops->get_event_data(value, &out);
+		raw.wobj = out.pointer;
 	}
 
-out_free_wobj:
-	kfree(wobj);
+	if (ACPI_FAILURE(ret) || !raw.wobj) {
+		if (raw.wobj)
+			hp_wmi_put_raw_event(state, &raw);
+		return;
+	}
 
-	devm_kfree(dev, event.name);
-	devm_kfree(dev, event.description);
+	spin_lock(&state->event_lock);
 
-out_unlock:
-	mutex_unlock(&state->lock);
-}
+	queued = kfifo_put(&state->events, raw);
 
-static int init_platform_events(struct device *dev,
-				struct hp_wmi_platform_events **out_pevents,
-				u8 *out_pcount)
-{
-	struct hp_wmi_platform_events *pevents_arr;
-	struct hp_wmi_platform_events *pevents;
-	union acpi_object *wobj;
-	u8 count;
-	int err;
-	u8 i;
+	spin_unlock(&state->event_lock);
 
-	count = hp_wmi_wobj_instance_count(HP_WMI_PLATFORM_EVENTS_GUID);
-	if (!count) {
-		*out_pcount = 0;
+	if (queued) {
+		schedule_work(&state->event_work);
+		return;
+	}
 
-		dev_dbg(dev, "No platform events\n");
+	hp_wmi_put_raw_event(state, &raw);
 
-		return 0;
-	}
+	trace_hp_wmi_sensors_event("", "", 0, -ENOSPC);
 
-	pevents_arr = devm_kcalloc(dev, count, sizeof(*pevents), GFP_KERNEL);
-	if (!pevents_arr)
-		return -ENOMEM;
+	atomic_inc(&state->event_stats.dropped);
+	dev_dbg_ratelimited(dev, "Event queue full, event dropped\n");
+}
 
-	for (i = 0, pevents = pevents_arr; i < count; i++, pevents++) {
-		wobj = hp_wmi_get_wobj(HP_WMI_PLATFORM_EVENTS_GUID, i);
-		if (!wobj)
-			return -EIO;
+/* hp_wmi_devm_kvfree - devm callback for freeing a sensor's history */
+static void hp_wmi_devm_kvfree(void *res)
+{
+	kvfree(res);
+}
 
-		err = populate_platform_events_from_wobj(dev, pevents, wobj);
+/*
+ * init_history - allocate the history of a connected sensor, if enabled
+ * @state: pointer to driver state
+ * @info: pointer to sensor info struct, with its reading laid out
+ *
+ * A history may take over a megabyte, so it need not be contiguous in
+ * physical memory. History is optional, so failure to allocate it is not
+ * an error.
+ */
+static void init_history(struct hp_wmi_sensors *state,
+			 struct hp_wmi_info *info)
+{
+	struct hp_wmi_history *history = &info->history;
+	struct hp_wmi_sample *samples;
 
-		kfree(wobj);
+	if (!IS_ENABLED(CONFIG_DEBUG_FS) || !state->history_len)
+		return;
 
-		if (err)
-			return err;
-	}
+	samples = kvcalloc(state->history_len, sizeof(*samples), GFP_KERNEL);
+	if (!samples)
+		return;
 
-	*out_pevents = pevents_arr;
-	*out_pcount = count;
+	if (devm_add_action_or_reset(state->dev, hp_wmi_devm_kvfree, samples))
+		return;
 
-	dev_dbg(dev, "Found %u platform events\n", count);
+	history->samples = samples;
 
-	return 0;
+	hp_wmi_record(state, info);
 }
 
-static int init_numeric_sensors(struct hp_wmi_sensors *state,
-				struct hp_wmi_info *connected[],
-				struct hp_wmi_info **out_info,
-				u8 *out_icount, u8 *out_count,
-				bool *out_is_new)
+static int init_numeric_sensors(struct hp_wmi_sensors *state, u16 *out_count)
 {
-	struct hp_wmi_info ***info_map = state->info_map;
-	u8 *channel_count = state->channel_count;
-	struct device *dev = &state->wdev->dev;
+	struct hp_wmi_reading **reading_map = state->reading_map;
+	u16 *channel_count = state->channel_count;
+	struct device *dev = state->dev;
 	struct hp_wmi_numeric_sensor *nsensor;
-	u8 channel_index[hwmon_max] = {};
+	u16 channel_index[hwmon_max] = {};
+	struct hp_wmi_limits *limits = NULL;
+	struct hp_wmi_reading *readings;
+	struct hp_wmi_reading *reading;
 	enum hwmon_sensor_types type;
 	struct hp_wmi_info *info_arr;
 	struct hp_wmi_info *info;
-	union acpi_object *wobj;
-	u8 count = 0;
-	bool is_new;
-	u8 icount;
+	acpi_size length[hwmon_max] = {};
+	struct acpi_buffer *wobjs;
+	u16 count = 0;
+	u16 icount;
+	u16 base;
 	int wtype;
 	int err;
-	u8 c;
-	u8 i;
+	u16 i;
 
-	icount = hp_wmi_wobj_instance_count(HP_WMI_NUMERIC_SENSOR_GUID);
-	if (!icount)
-		return -ENODATA;
+	err = hp_wmi_get_wobjs(HP_WMI_NUMERIC_SENSOR_GUID, &wobjs);
+	if (err <= 0) {
+		if (!err)
+			err = -ENODATA;
+		goto out_put_wobjs;
+	}
+
+	icount = err;
 
 	info_arr = devm_kcalloc(dev, icount, sizeof(*info), GFP_KERNEL);
-	if (!info_arr)
-		return -ENOMEM;
+	if (!info_arr) {
+		err = -ENOMEM;
+		goto out_put_wobjs;
+	}
 
-	for (i = 0, info = info_arr; i < icount; i++, info++) {
-		wobj = hp_wmi_get_wobj(HP_WMI_NUMERIC_SENSOR_GUID, i);
-		if (!wobj)
-			return -EIO;
+	readings = devm_kcalloc(dev, icount, sizeof(*readings), GFP_KERNEL);
+	if (!readings) {
+		err = -ENOMEM;
+		goto out_put_wobjs;
+	}
 
+	for (i = 0, info = info_arr; i < icount; i++, info++) {
 		info->instance = i;
 		info->state = state;
 		nsensor = &info->nsensor;
 
-		err = populate_numeric_sensor_from_wobj(dev, nsensor, wobj,
-							&is_new);
-
-		kfree(wobj);
-
+		err = populate_numeric_sensor_from_wobj(dev, nsensor,
+							&info->layout,
+							wobjs[i].pointer);
 		if (err)
-			return err;
+			goto out_put_wobjs;
+
+		info->name_hash = hp_wmi_name_hash(wobjs[i].pointer);
+
+		if (IS_ENABLED(CONFIG_DEBUG_FS) && !slim) {
+			info->raw = devm_kzalloc(dev, HP_WMI_RAW_SIZE,
+						 GFP_KERNEL);
+			if (info->raw)
+				info->raw_size =
+					serialize_wobj(wobjs[i].pointer,
+						       info->raw,
+						       HP_WMI_RAW_SIZE);
+		}
 
 		if (!numeric_sensor_is_connected(nsensor))
 			continue;
@@ -1796,40 +4433,76 @@ static int init_numeric_sensors(struct hp_wmi_sensors *state,
 
 		info->type = type;
 
-		interpret_info(info);
-
-		connected[count++] = info;
+		count++;
 	}
 
 	dev_dbg(dev, "Found %u sensors (%u connected)\n", i, count);
 
-	for (i = 0; i < count; i++) {
-		info = connected[i];
+	if (count) {
+		limits = devm_kcalloc(dev, count, sizeof(*limits), GFP_KERNEL);
+		if (!limits) {
+			err = -ENOMEM;
+			goto out_put_wobjs;
+		}
+	}
+
+	/* Lay out readings by hwmon type, then by channel number. */
+	for (type = hwmon_chip, base = 0; type < hwmon_max; type++) {
+		if (!channel_count[type])
+			continue;
+
+		reading_map[type] = &readings[base];
+		base += channel_count[type];
+	}
+
+	/* Readings of disconnected sensors go after all others. */
+	for (i = 0, info = info_arr; i < icount; i++, info++) {
 		type = info->type;
-		c = channel_index[type]++;
-
-		if (!info_map[type]) {
-			info_map[type] = devm_kcalloc(dev, channel_count[type],
-						      sizeof(*info_map),
-						      GFP_KERNEL);
-			if (!info_map[type])
-				return -ENOMEM;
+
+		/* Connected sensors are never of type hwmon_chip. */
+		if (type == hwmon_chip)
+			reading = &readings[base++];
+		else
+			reading = &reading_map[type][channel_index[type]++];
+
+		reading->instance = i;
+		reading->type = type;
+		info->reading = reading;
+
+		/* This also starts the history, unless the sensor is faulty. */
+		if (type != hwmon_chip) {
+			interpret_info(info);
+			init_history(state, info);
 		}
 
-		info_map[type][c] = info;
+		length[type] = max(length[type], wobjs[i].length);
+	}
+
+	/* Size the scratch buffers up front for later refreshes. */
+	for (type = hwmon_chip; type < hwmon_max; type++) {
+		err = hp_wmi_grow_scratch(dev, &state->groups[type].scratch,
+					  length[type]);
+		if (err)
+			goto out_put_wobjs;
 	}
 
-	*out_info = info_arr;
-	*out_icount = icount;
+	state->info = info_arr;
+	state->readings = readings;
+	state->limits = limits;
+	state->icount = icount;
+	state->count = count;
+
 	*out_count = count;
-	*out_is_new = is_new;
 
-	return 0;
+out_put_wobjs:
+	hp_wmi_put_wobjs(wobjs);
+
+	return err;
 }
 
 static bool find_event_attributes(struct hp_wmi_sensors *state,
 				  struct hp_wmi_platform_events *pevents,
-				  u8 pevents_count)
+				  u16 pevents_count)
 {
 	/*
 	 * The existence of this HPBIOS_PlatformEvents instance:
@@ -1884,72 +4557,117 @@ static bool find_event_attributes(struct hp_wmi_sensors *state,
 	 *   events (cf. the ProBook 4540s and ProBook 470 G0 [3]).
 	 */
 
-	struct hp_wmi_info *temp_info[HP_WMI_MAX_INSTANCES] = {};
+	DECLARE_BITMAP(channels, HP_WMI_MAX_INSTANCES);
+	struct device *dev = state->dev;
+	enum hwmon_sensor_types type;
 	const char *event_description;
-	struct hp_wmi_info *fan_info;
+	struct hp_wmi_route *route;
+	struct hp_wmi_info *info;
 	bool has_events = false;
 	const char *event_name;
 	u32 event_category;
 	int event_type;
-	u8 count;
-	u8 i;
+	u16 i;
 
 	for (i = 0; i < pevents_count; i++, pevents++) {
 		event_name = pevents->name;
 		event_description = pevents->description;
 		event_category = pevents->category;
 
+		bitmap_zero(channels, HP_WMI_MAX_INSTANCES);
+
 		event_type = classify_event(event_name, event_category);
 		switch (event_type) {
 		case HP_WMI_TYPE_AIR_FLOW:
-			fan_info = match_fan_event(state, event_description);
-			if (!fan_info)
-				break;
+			info = match_fan_event(state, event_description);
+			if (!info)
+				continue;
 
-			fan_info->has_alarm = true;
-			has_events = true;
+			type = hwmon_fan;
+			__set_bit(hp_wmi_reading_channel(state, info->reading),
+				  channels);
 			break;
 
 		case HP_WMI_TYPE_INTRUSION:
 			state->has_intrusion = true;
-			has_events = true;
+			type = hwmon_intrusion;
+			__set_bit(0, channels);
 			break;
 
 		case HP_WMI_TYPE_TEMPERATURE:
-			count = match_temp_events(state, event_description,
-						  temp_info);
-			if (!count)
-				break;
+			if (!match_temp_events(state, event_description,
+					       channels))
+				continue;
 
-			while (count)
-				temp_info[--count]->has_alarm = true;
-			has_events = true;
+			type = hwmon_temp;
 			break;
 
 		default:
-			break;
+			continue;
 		}
+
+		has_events = true;
+
+		/* Without a route, the alarm flag simply never gets set. */
+		route = devm_kzalloc(dev, sizeof(*route), GFP_KERNEL);
+		if (!route)
+			continue;
+
+		route->key = hp_wmi_event_hash(event_name, event_description);
+		route->name = event_name;
+		route->description = event_description;
+		route->type = type;
+		bitmap_copy(route->channels, channels, HP_WMI_MAX_INSTANCES);
+
+		hash_add(state->routes, &route->node, route->key);
 	}
 
 	return has_events;
 }
 
+/*
+ * add_event_alarms - add alarm flags to channels that BIOS events cover
+ * @state: pointer to driver state
+ * @type: hwmon sensor type
+ * @config: hwmon channel configuration for @type, indexed by channel
+ */
+static void add_event_alarms(const struct hp_wmi_sensors *state,
+			     enum hwmon_sensor_types type, u32 *config)
+{
+	const struct hp_wmi_route *route;
+	unsigned long channel;
+	unsigned int bkt;
+	u32 attr;
+
+	if (type == hwmon_temp)
+		attr = HWMON_T_ALARM;
+	else if (type == hwmon_fan)
+		attr = HWMON_F_ALARM;
+	else
+		return;
+
+	hash_for_each(state->routes, bkt, route, node) {
+		if (route->type != type)
+			continue;
+
+		for_each_set_bit(channel, route->channels, HP_WMI_MAX_INSTANCES)
+			config[channel] |= attr;
+	}
+}
+
 static int make_chip_info(struct hp_wmi_sensors *state, bool has_events)
 {
 	const struct hwmon_channel_info **ptr_channel_info;
-	struct hp_wmi_info ***info_map = state->info_map;
-	u8 *channel_count = state->channel_count;
+	u16 *channel_count = state->channel_count;
 	struct hwmon_channel_info *channel_info;
-	struct device *dev = &state->wdev->dev;
+	struct device *dev = state->dev;
 	enum hwmon_sensor_types type;
 	u8 type_count = 0;
 	u32 *config;
 	u32 attr;
-	u8 count;
-	u8 i;
+	u16 count;
 
-	if (channel_count[hwmon_temp])
-		channel_count[hwmon_chip] = 1;
+	channel_count[hwmon_chip] = 1;
 
 	if (has_events && state->has_intrusion)
 		channel_count[hwmon_intrusion] = 1;
@@ -1980,21 +4698,22 @@ static int make_chip_info(struct hp_wmi_sensors *state, bool has_events)
 		if (!config)
 			return -ENOMEM;
 
+		/* The driver's own thresholds have alarm flags of their own. */
 		attr = hp_wmi_hwmon_attributes[type];
+		if (type == hwmon_temp)
+			attr |= HWMON_T_MAX | HWMON_T_MAX_ALARM |
+				HWMON_T_CRIT | HWMON_T_CRIT_ALARM;
+		else if (type == hwmon_fan)
+			attr |= HWMON_F_MIN | HWMON_F_MIN_ALARM;
+
 		channel_info->type = type;
 		channel_info->config = config;
 		memset32(config, attr, count);
 
-		*ptr_channel_info++ = channel_info++;
-
-		if (!has_events || (type != hwmon_temp && type != hwmon_fan))
-			continue;
-
-		attr = type == hwmon_temp ? HWMON_T_ALARM : HWMON_F_ALARM;
+		if (has_events)
+			add_event_alarms(state, type, config);
 
-		for (i = 0; i < count; i++)
-			if (info_map[type][i]->has_alarm)
-				config[i] |= attr;
+		*ptr_channel_info++ = channel_info++;
 	}
 
 	return 0;
@@ -2002,11 +4721,31 @@ static int make_chip_info(struct hp_wmi_sensors *state, bool has_events)
 
 static bool add_event_handler(struct hp_wmi_sensors *state)
 {
-	struct device *dev = &state->wdev->dev;
+	struct device *dev = state->dev;
+	u8 *bufs;
 	int err;
+	u8 i;
+
+	/*
+	 * Each buffer is much larger than any HPBIOS_BIOSEvent instance seen
+	 * in practice. There is one per queue entry, so that the pool only
+	 * runs dry when the queue is full anyway.
+	 */
+	bufs = devm_kcalloc(dev, HP_WMI_EVENT_QUEUE_LEN,
+			    HP_WMI_EVENT_BUF_SIZE, GFP_KERNEL);
+	if (!bufs)
+		return false;
+
+	for (i = 0; i < HP_WMI_EVENT_QUEUE_LEN; i++)
+		kfifo_put(&state->event_bufs, bufs + i * HP_WMI_EVENT_BUF_SIZE);
+
+	err = devm_add_action_or_reset(dev, hp_wmi_devm_event_cancel,
+				       &state->event_work);
+	if (err)
+		return false;
 
-	err = wmi_install_notify_handler(HP_WMI_EVENT_GUID,
-					 hp_wmi_notify, state);
+	err = hp_wmi_ops->install_notify_handler(HP_WMI_EVENT_GUID,
+						 hp_wmi_notify, state);
 	if (err) {
 		dev_info(dev, "Failed to subscribe to WMI event\n");
 		return false;
@@ -2019,37 +4758,128 @@ static bool add_event_handler(struct hp_wmi_sensors *state)
 	return true;
 }
 
+static int start_polling(struct hp_wmi_sensors *state)
+{
+	struct device *dev = state->dev;
+	int err;
+
+	state->poll_interval = msecs_to_jiffies(poll_interval);
+
+	INIT_DELAYED_WORK(&state->poll_work, hp_wmi_poll_work);
+
+	err = devm_add_action_or_reset(dev, hp_wmi_devm_poll_cancel,
+				       &state->poll_work);
+	if (err)
+		return err;
+
+	/* Otherwise, writing a threshold queues the work. */
+	if (state->poll_interval)
+		queue_delayed_work(system_freezable_wq, &state->poll_work,
+				   state->poll_interval);
+
+	return 0;
+}
+
+/*
+ * hp_wmi_slim_down - free data only needed for debugfs after probe
+ * @state: pointer to driver state
+ *
+ * The strings of the event dispatch table are compacted into one arena,
+ * after which platform events objects are freed; so are all properties of
+ * disconnected sensors and those properties of other sensors not used for
+ * hwmon. Debugfs rebuilds what it needs from WMI on demand.
+ */
+static void hp_wmi_slim_down(struct hp_wmi_sensors *state)
+{
+	struct device *dev = state->dev;
+	struct hp_wmi_route *route;
+	struct hp_wmi_info *info;
+	size_t name_size;
+	size_t desc_size;
+	size_t size = 0;
+	char *arena;
+	int bkt;
+	u16 i;
+
+	hash_for_each(state->routes, bkt, route, node)
+		size += strlen(route->name) + strlen(route->description) + 2;
+
+	arena = size ? devm_kmalloc(dev, size, GFP_KERNEL) : NULL;
+	if (arena || !size) {
+		hash_for_each(state->routes, bkt, route, node) {
+			name_size = strlen(route->name) + 1;
+			desc_size = strlen(route->description) + 1;
+
+			route->name = memcpy(arena, route->name, name_size);
+			arena += name_size;
+			route->description = memcpy(arena, route->description,
+						     desc_size);
+			arena += desc_size;
+		}
+
+		put_platform_events(dev, state->pevents, state->pcount);
+		state->pevents = NULL;
+	}
+
+	for (i = 0, info = state->info; i < state->icount; i++, info++) {
+		if (info->type == hwmon_chip)
+			put_numeric_sensor(dev, &info->nsensor);
+		else
+			put_numeric_sensor_cold(dev, &info->nsensor);
+	}
+}
+
 static int hp_wmi_sensors_init(struct hp_wmi_sensors *state)
 {
-	struct hp_wmi_info *connected[HP_WMI_MAX_INSTANCES];
 	struct hp_wmi_platform_events *pevents = NULL;
-	struct device *dev = &state->wdev->dev;
-	struct hp_wmi_info *info;
+	struct device *dev = state->dev;
 	struct device *hwdev;
-	bool has_events;
-	bool is_new;
-	u8 icount;
-	u8 pcount;
-	u8 count;
+	bool has_events = false;
+	u16 pcount;
+	u16 count;
 	int err;
 
 	err = init_platform_events(dev, &pevents, &pcount);
 	if (err)
 		return err;
 
-	err = init_numeric_sensors(state, connected, &info,
-				   &icount, &count, &is_new);
+	dev_dbg(dev, "Found %u platform events\n", pcount);
+
+	err = init_numeric_sensors(state, &count);
+	if (err)
+		return err;
+
+	state->pevents = pevents;
+	state->pcount = pcount;
+
+	/*
+	 * Anything that may queue notifications must be stopped before this,
+	 * including debugfs, whose reads may refresh sensors.
+	 */
+	err = devm_add_action_or_reset(dev, hp_wmi_devm_notify_cancel, state);
+	if (err)
+		return err;
+
+	INIT_WORK(&state->resume_work, hp_wmi_resume_work);
+
+	err = devm_add_action_or_reset(dev, hp_wmi_devm_resume_cancel,
+				       &state->resume_work);
 	if (err)
 		return err;
 
+	if (count)
+		has_events = find_event_attributes(state, pevents, pcount);
+
+	/* Nothing may look at what this frees yet: no events, no files. */
+	if (slim)
+		hp_wmi_slim_down(state);
+
 	if (IS_ENABLED(CONFIG_DEBUG_FS))
-		hp_wmi_debugfs_init(dev, info, pevents, icount, pcount, is_new);
+		hp_wmi_debugfs_init(state);
 
 	if (!count)
 		return 0;	/* No connected sensors; debugfs only. */
 
-	has_events = find_event_attributes(state, pevents, pcount);
-
 	/* Survive failure to install WMI event handler. */
 	if (has_events && !add_event_handler(state))
 		has_events = false;
@@ -2058,42 +4888,177 @@ static int hp_wmi_sensors_init(struct hp_wmi_sensors *state)
 	if (err)
 		return err;
 
+	err = start_polling(state);
+	if (err)
+		return err;
+
 	hwdev = devm_hwmon_device_register_with_info(dev, "hp_wmi_sensors",
 						     state, &hp_wmi_chip_info,
 						     NULL);
-	return PTR_ERR_OR_ZERO(hwdev);
+	if (IS_ERR(hwdev))
+		return PTR_ERR(hwdev);
+
+	WRITE_ONCE(state->hwdev, hwdev);
+
+	/* Stop sending notifications before the hwmon device goes away. */
+	return devm_add_action_or_reset(dev, hp_wmi_devm_notify_cancel, state);
 }
 
-static int hp_wmi_sensors_probe(struct wmi_device *wdev, const void *context)
+/* hp_wmi_sensors_attach - set up driver state on a WMI or fake device */
+static int hp_wmi_sensors_attach(struct device *dev)
 {
-	struct device *dev = &wdev->dev;
+	enum hwmon_sensor_types type;
 	struct hp_wmi_sensors *state;
+	struct hp_wmi_group *group;
 
 	state = devm_kzalloc(dev, sizeof(*state), GFP_KERNEL);
 	if (!state)
 		return -ENOMEM;
 
-	state->wdev = wdev;
+	state->dev = dev;
 
-	mutex_init(&state->lock);
+	state->history_len = min(history_len, HP_WMI_MAX_HISTORY_LEN);
+	state->update_interval = HP_WMI_DEFAULT_UPDATE_INTERVAL;
+
+	for (type = hwmon_chip; type < hwmon_max; type++) {
+		group = &state->groups[type];
+
+		mutex_init(&group->lock);
+		seqcount_mutex_init(&group->seq, &group->lock);
+	}
+	INIT_WORK(&state->notify_work, hp_wmi_notify_work);
+	INIT_WORK(&state->event_work, hp_wmi_event_work);
+	INIT_KFIFO(state->event_bufs);
+	INIT_KFIFO(state->events);
+	spin_lock_init(&state->event_lock);
+	hash_init(state->routes);
 
 	dev_set_drvdata(dev, state);
 
 	return hp_wmi_sensors_init(state);
 }
 
+/*
+ * hp_wmi_sensors_resume - invalidate cached readings after system resume
+ * @dev: pointer to the WMI or fake device
+ *
+ * Readings cached before suspend may be arbitrarily old. They are marked
+ * stale right away, so that none is served to a reader, and then refreshed
+ * by hp_wmi_resume_work() once tasks are thawed. Until then, readers
+ * refresh stale readings themselves even when polling in the background.
+ */
+static int hp_wmi_sensors_resume(struct device *dev)
+{
+	struct hp_wmi_sensors *state = dev_get_drvdata(dev);
+	struct hp_wmi_reading *reading;
+	struct hp_wmi_group *group;
+	struct hp_wmi_info *info;
+	u16 i;
+
+	if (!state->count)
+		return 0;	/* No connected sensors; nothing to refresh. */
+
+	set_bit(0, &state->resuming);
+
+	for (i = 0, info = state->info; i < state->icount; i++, info++) {
+		group = &state->groups[info->type];
+		reading = info->reading;
+
+		mutex_lock(&group->lock);
+
+		info->verify = true;
+
+		write_seqcount_begin(&group->seq);
+		WRITE_ONCE(reading->backoff, 0);
+		reading->last_updated = jiffies - LONG_MAX;
+		write_seqcount_end(&group->seq);
+
+		mutex_unlock(&group->lock);
+	}
+
+	queue_work(system_freezable_wq, &state->resume_work);
+
+	return 0;
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(hp_wmi_sensors_pm_ops, NULL,
+				hp_wmi_sensors_resume);
+
+#ifndef HP_WMI_SENSORS_FAKE_WMI
+
+static int hp_wmi_sensors_probe(struct wmi_device *wdev, const void *context)
+{
+	return hp_wmi_sensors_attach(&wdev->dev);
+}
+
 static const struct wmi_device_id hp_wmi_sensors_id_table[] = {
 	{ HP_WMI_NUMERIC_SENSOR_GUID, NULL },
 	{},
 };
 
 static struct wmi_driver hp_wmi_sensors_driver = {
-	.driver   = { .name = "hp-wmi-sensors" },
+	.driver   = {
+		.name = "hp-wmi-sensors",
+		/* Enumeration waits on firmware; keep it off the boot path. */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.pm = pm_sleep_ptr(&hp_wmi_sensors_pm_ops),
+	},
 	.id_table = hp_wmi_sensors_id_table,
 	.probe    = hp_wmi_sensors_probe,
 };
 module_wmi_driver(hp_wmi_sensors_driver);
 
+#else /* HP_WMI_SENSORS_FAKE_WMI */
+
+static int hp_wmi_fake_probe(struct platform_device *pdev)
+{
+	return hp_wmi_sensors_attach(&pdev->dev);
+}
+
+static struct platform_driver hp_wmi_fake_driver = {
+	.driver = {
+		.name = "hp-wmi-sensors-fake",
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.pm = pm_sleep_ptr(&hp_wmi_sensors_pm_ops),
+	},
+	.probe  = hp_wmi_fake_probe,
+};
+
+static struct platform_device *hp_wmi_fake_pdev;
+
+static int __init hp_wmi_fake_init(void)
+{
+	int err;
+
+	err = platform_driver_register(&hp_wmi_fake_driver);
+	if (err)
+		return err;
+
+	/* Id 0, not PLATFORM_DEVID_NONE: it names the debugfs directory. */
+	hp_wmi_fake_pdev = platform_device_register_simple(
+		"hp-wmi-sensors-fake", 0, NULL, 0);
+	if (IS_ERR(hp_wmi_fake_pdev)) {
+		platform_driver_unregister(&hp_wmi_fake_driver);
+		return PTR_ERR(hp_wmi_fake_pdev);
+	}
+
+	return 0;
+}
+module_init(hp_wmi_fake_init);
+
+static void __exit hp_wmi_fake_exit(void)
+{
+	platform_device_unregister(hp_wmi_fake_pdev);
+	platform_driver_unregister(&hp_wmi_fake_driver);
+}
+module_exit(hp_wmi_fake_exit);
+
+#endif /* HP_WMI_SENSORS_FAKE_WMI */
+
+#ifdef HP_WMI_SENSORS_KUNIT
+#include "hp-wmi-sensors-kunit.c"
+#endif
+
 MODULE_AUTHOR("James Seo <james@equiv.tech>");
 MODULE_DESCRIPTION("HP WMI Sensors driver");
 MODULE_LICENSE("GPL");
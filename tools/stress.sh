@@ -0,0 +1,141 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# stress.sh - hammer hp-wmi-sensors hwmon attributes from many readers
+#
+# Usage: stress.sh [-t readers] [-d seconds] [-e events] [-a glob]
+#
+# Meant for a module built against fake firmware (see README.rst), whose
+# fake_delay_us parameter makes firmware latency repeatable, but it works on
+# real hardware too. Each reader sweeps all attributes matching the glob
+# (default: *_input) in turn, as a monitoring daemon would, and times every
+# read. With -e, a writer meanwhile injects bursts of that many fake WMI
+# events through the fake_event_storm parameter.
+#
+# Needs bash 5 for EPOCHREALTIME, so that timing a read forks nothing.
+
+set -euo pipefail
+
+readers=$(nproc)
+duration=10
+events=0
+glob='*_input'
+
+usage() {
+	echo "Usage: $0 [-t readers] [-d seconds] [-e events] [-a glob]" >&2
+	exit 1
+}
+
+while getopts t:d:e:a:h opt; do
+	case $opt in
+	t) readers=$OPTARG ;;
+	d) duration=$OPTARG ;;
+	e) events=$OPTARG ;;
+	a) glob=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+if [[ -z ${EPOCHREALTIME-} ]]; then
+	echo "$0: bash 5 or later is required" >&2
+	exit 1
+fi
+
+hwmon=
+for dir in /sys/class/hwmon/hwmon*; do
+	if [[ -r $dir/name && $(<"$dir/name") == hp_wmi_sensors ]]; then
+		hwmon=$dir
+		break
+	fi
+done
+
+if [[ -z $hwmon ]]; then
+	echo "$0: no hp_wmi_sensors hwmon device found" >&2
+	exit 1
+fi
+
+attrs=()
+for attr in "$hwmon"/$glob; do
+	[[ -f $attr ]] && attrs+=("$attr")
+done
+
+if (( ! ${#attrs[@]} )); then
+	echo "$0: no attributes in $hwmon match $glob" >&2
+	exit 1
+fi
+
+storm_param=/sys/module/hp_wmi_sensors/parameters/fake_event_storm
+if (( events )) && [[ ! -w $storm_param ]]; then
+	echo "$0: -e needs a fake firmware build, run as root" >&2
+	exit 1
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# now - microseconds since the epoch
+now() {
+	now_us=${EPOCHREALTIME/[.,]/}
+}
+
+# reader - sweep all attributes until @end, one latency in us per line
+reader() {
+	local end=$1
+	local attr
+	local val
+	local t0
+
+	while now && (( now_us < end )); do
+		for attr in "${attrs[@]}"; do
+			t0=${EPOCHREALTIME/[.,]/}
+			if { read -r val <"$attr"; } 2>/dev/null; then
+				now
+				echo "$((now_us - t0))"
+			else
+				echo error
+			fi
+		done
+	done
+}
+
+# storm - inject bursts of fake WMI events until @end
+storm() {
+	local end=$1
+
+	while now && (( now_us < end )); do
+		echo "$events" >"$storm_param"
+	done
+}
+
+now
+start=$now_us
+end=$((start + duration * 1000000))
+
+for ((i = 0; i < readers; i++)); do
+	reader "$end" >"$tmp/reader.$i" &
+done
+
+if (( events )); then
+	storm "$end" &
+fi
+
+wait
+
+now
+elapsed=$((now_us - start))
+
+echo "device:     $hwmon (${#attrs[@]} attributes)"
+echo "readers:    $readers"
+
+cat "$tmp"/reader.* | sort -n | awk -v elapsed="$elapsed" '
+	/^error$/ { errors++; next }
+	{ lat[n++] = $1; sum += $1 }
+	END {
+		printf "reads:      %d (%.0f/s)\n", n, n / (elapsed / 1e6)
+		printf "errors:     %d\n", errors
+		if (!n)
+			exit
+		printf "latency us: mean %.1f p50 %d p90 %d p99 %d max %d\n",
+		       sum / n, lat[int(n * 0.50)], lat[int(n * 0.90)],
+		       lat[int(n * 0.99)], lat[n - 1]
+	}'